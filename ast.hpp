@@ -0,0 +1,129 @@
+// SimpliC Language - Parsed Program (syntax tree, parser and optimizer)
+#pragma once
+
+#include "simplic.hpp"
+#include <atomic>
+
+struct Expr;
+struct Stmt;
+using ExprPtr = std::shared_ptr<Expr>;
+using StmtPtr = std::shared_ptr<Stmt>;
+using Block = std::vector<StmtPtr>;
+
+// Binary operators
+enum class Op {
+    Plus, Minus, Times, Divide, Mod,
+    MoreThan, LessThan, Equals, NotEqual,
+    Unknown
+};
+
+Op op_from_word(const std::string &word);
+bool is_comparison_op(Op op);
+
+// Native method: obj is the receiver, call.args[1..] its arguments
+using NativeMethod = Value (*)(Value &obj, const Expr &call, Environment &env);
+
+struct MethodEntry {
+    Value::Type type;
+    int method;
+    NativeMethod fn;
+};
+
+// Interned id of a native method name, -1 if no type has it
+int method_id(const std::string &name);
+
+// Monomorphic inline cache for one call site: the entry used last time,
+// reused while the receiver has the same type. Copies start empty.
+struct MethodCache {
+    mutable std::atomic<const MethodEntry *> entry{nullptr};
+    MethodCache() {}
+    MethodCache(const MethodCache &) {}
+    MethodCache &operator=(const MethodCache &) { entry = nullptr; return *this; }
+};
+
+struct Expr {
+    enum class Kind {
+        Literal,    // number, "word", yes/no
+        Var,        // name
+        Binary,     // args[0] op args[1]
+        Call,       // name(args...)
+        Method,     // args[0].name(args[1..])
+        Subscript   // args[0][args[1]]
+    } kind = Kind::Literal;
+
+    Value literal;
+    std::string name;           // variable, function or method name; operator word for Binary
+    Op op = Op::Unknown;
+    std::vector<ExprPtr> args;
+    bool parens = false;        // Method: written with ()
+    bool name_fallback = false; // Var used as a map key: an unset name means the name itself
+    int method = -1;            // Method: interned name
+    MethodCache cache;          // Method: last dispatch
+    bool unboxed = false;       // only numbers flow through this tree (infer.cpp)
+    int line = 0;
+};
+
+struct Stmt {
+    enum class Kind {
+        Make,      // make <type> <name> [= expr]    (type is empty for: make <name> is <expr>;
+               //                                 heaps: make heap <name> [by <expr>])
+        Show,      // show <parts>
+        Put,       // put <expr> into <name>
+        Takeout,   // takeout <name>
+        When,      // when <expr> <body> [otherwise <else_body>] done
+        ForEach,   // [parallel] for [each] <name> in <expr> <body> done
+        ForRange,  // for <name> from <expr> to <expr2> [step <expr3>] <body> done
+        Repeat,    // repeat <expr> times <body> done
+        Define,    // define <name> [with <param>] <body> done
+        Giveback,  // giveback <expr>
+        Reduce,    // sum|count|collect [<expr>] into <name>
+        Eval,      // an expression run for its effect: obj.method(...), f(...)
+        SetIndex,  // <name>[<expr2>] = <expr>
+        Load,      // load <type> <name> from <expr>
+        Save,      // save <expr> to <expr2>
+        Snapshot,  // snapshot <expr>
+        Restore    // restore <expr>
+    } kind = Kind::Eval;
+
+    int line = 0;
+    std::string name;
+    std::string type;   // Make: declared type; Define: parameter; Reduce: sum/count/collect; Load: kind
+    ExprPtr expr, expr2, expr3;
+    Block body, else_body;  // loops: else_body holds the temporaries the optimizer hoisted out
+    bool parallel = false;
+
+    // Make list / make numbers with a [...] initializer
+    bool literal_list = false;
+    std::vector<ExprPtr> items;      // elements that need evaluating
+    List literal_values;             // list: every element was a constant
+    std::vector<double> literal_numbers; // numbers: every element was a number
+
+    // Show: 'e' takes the next expression from items, ',' and ';' are separators
+    std::string show_parts;
+};
+
+struct Program {
+    Block body;
+    std::vector<std::string> opt_report;  // one line per change made by optimize_program
+    std::vector<std::string> warnings;    // type mismatches found by infer_types
+    bool uses_memstats = false;           // calls memstats(), so its runs need the counters on
+};
+
+// parser.cpp
+std::shared_ptr<Program> parse_program(const std::vector<std::vector<std::string>> &lines);
+std::string expr_to_string(const Expr &e);
+// Blocks (define, when, for, repeat) still waiting for their "done" at the
+// end of lines; the REPL reads on while this is above zero
+int open_blocks(const std::vector<std::vector<std::string>> &lines);
+
+// optimizer.cpp
+void optimize_program(Program &prog);
+
+// infer.cpp
+void infer_types(Program &prog);
+
+// interpreter.cpp
+Value eval_binary(const Value &a, Op op, const Value &b);
+// Runs a block; returns true once a giveback has run (its value is in return_value)
+bool run_block(const Block &block, Environment &env, Value *return_value);
+void run_program(const Program &prog, Environment &env, Value *return_value);
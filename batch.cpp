@@ -0,0 +1,176 @@
+// batch.cpp
+// Runs many scripts in one process: scripts are spread over the worker pool,
+// each gets its own Interpreter and output buffer, and scripts with the same
+// source share one compiled program.
+
+#include "batch.hpp"
+#include "interpreter.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+namespace {
+
+struct ScriptResult {
+    std::string path;
+    std::string status = "ok";  // ok, error, timeout, budget or memory
+    std::string message;
+    std::string output;
+    double seconds = 0;
+};
+
+// Compiled programs by source text; compiling happens outside the lock, so
+// two scripts racing on a new source may both compile it once
+class ProgramCache {
+public:
+    explicit ProgramCache(bool on_disk) : disk(on_disk) {}
+
+    std::shared_ptr<const Program> get(const std::string &source) {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            auto it = programs.find(source);
+            if (it != programs.end()) return it->second;
+        }
+        auto prog = disk ? Interpreter::compile_cached(source) : Interpreter::compile(source);
+        std::lock_guard<std::mutex> lock(m);
+        return programs.insert(std::make_pair(source, prog)).first->second;
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(m);
+        return programs.size();
+    }
+
+private:
+    bool disk;
+    std::mutex m;
+    std::unordered_map<std::string, std::shared_ptr<const Program>> programs;
+};
+
+bool is_directory(const std::string &path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && (st.st_mode & S_IFMT) == S_IFDIR;
+}
+
+bool ends_with(const std::string &s, const std::string &suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// The .simplic files directly inside dir, sorted by name
+std::vector<std::string> scripts_in(const std::string &dir) {
+    std::vector<std::string> names;
+#if defined(_WIN32)
+    WIN32_FIND_DATAA found;
+    HANDLE h = FindFirstFileA((dir + "\\*.simplic").c_str(), &found);
+    if (h != INVALID_HANDLE_VALUE) {
+        do {
+            if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) names.push_back(found.cFileName);
+        } while (FindNextFileA(h, &found));
+        FindClose(h);
+    }
+#else
+    DIR *d = opendir(dir.c_str());
+    if (!d) throw std::runtime_error("could not open directory: " + dir);
+    while (dirent *entry = readdir(d)) {
+        std::string name = entry->d_name;
+        if (ends_with(name, ".simplic")) names.push_back(name);
+    }
+    closedir(d);
+#endif
+    std::sort(names.begin(), names.end());
+    std::string sep = (!dir.empty() && (dir.back() == '/' || dir.back() == '\\')) ? "" : "/";
+    for (auto &name : names) name = dir + sep + name;
+    return names;
+}
+
+// One path per line; blank lines and lines starting with # are skipped
+std::vector<std::string> scripts_listed(const std::string &list) {
+    std::ifstream f(list);
+    if (!f) throw std::runtime_error("could not open script list: " + list);
+    std::vector<std::string> paths;
+    std::string line;
+    while (std::getline(f, line)) {
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t')) line.pop_back();
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line[start] == '#') continue;
+        paths.push_back(line.substr(start));
+    }
+    return paths;
+}
+
+void run_script(ScriptResult &r, ProgramCache &cache, const BatchOptions &opts) {
+    auto started = std::chrono::steady_clock::now();
+    std::ostringstream out;
+    try {
+        std::ifstream f(r.path);
+        if (!f) throw std::runtime_error("could not open file: " + r.path);
+        std::ostringstream source;
+        source << f.rdbuf();
+
+        auto prog = cache.get(source.str());
+        if (prog->uses_memstats && !opts.mem_stats) {
+            throw std::runtime_error("memstats() would count every script running alongside this one; run it on "
+                                     "its own, or add --mem-stats to count the whole batch");
+        }
+        Interpreter interp(out);
+        interp.set_limits(opts.max_steps, opts.timeout_seconds);
+        interp.set_heap_limit(opts.heap_limit);
+        Value ret = interp.run(*prog);
+        if (ret.type != Value::Type::Nil) out << ret.to_string() << std::endl;
+    } catch (const RunLimitError &e) {
+        r.status = e.limit == RunLimitError::Limit::Time ? "timeout" : e.limit == RunLimitError::Limit::Heap ? "memory" : "budget";
+        r.message = e.what();
+    } catch (const std::exception &e) {
+        r.status = "error";
+        r.message = e.what();
+    }
+    r.output = out.str();
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+}
+
+} // namespace
+
+size_t run_batch(const std::string &target, const BatchOptions &opts, std::ostream &out) {
+    std::vector<std::string> paths = is_directory(target) ? scripts_in(target) : scripts_listed(target);
+    std::vector<ScriptResult> results(paths.size());
+    for (size_t k = 0; k < paths.size(); ++k) results[k].path = paths[k];
+
+    ProgramCache cache(opts.disk_cache);
+    auto started = std::chrono::steady_clock::now();
+    parallel_for(results.size(), [&](size_t k) { run_script(results[k], cache, opts); });
+    double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    size_t failed = 0;
+    for (auto &r : results) {
+        out << "=== " << r.path << std::endl << r.output;
+        if (r.status != "ok") {
+            out << r.status << ": " << r.message << std::endl;
+            ++failed;
+        }
+    }
+
+    char buf[64];
+    out << std::endl << "status    seconds  script" << std::endl;
+    for (auto &r : results) {
+        std::snprintf(buf, sizeof(buf), "%-8s %8.3f  ", r.status.c_str(), r.seconds);
+        out << buf << r.path << std::endl;
+    }
+    std::snprintf(buf, sizeof(buf), "%.3f", total);
+    out << results.size() << " scripts, " << (results.size() - failed) << " ok, " << failed << " failed; "
+        << cache.size() << " distinct programs; " << parallel_threads() << " threads; " << buf << "s" << std::endl;
+    return failed;
+}
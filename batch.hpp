@@ -0,0 +1,23 @@
+// SimpliC Language - Batch Runner (--batch)
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+struct BatchOptions {
+    uint64_t max_steps = 0;      // per script, 0 for no budget
+    double timeout_seconds = 0;  // per script, 0 for no limit
+    size_t heap_limit = 0;       // per script, bytes kept after a collection
+    bool disk_cache = true;      // also keep compiled programs on disk (cache.cpp)
+    bool mem_stats = false;      // --mem-stats: counting is on for the whole batch
+};
+
+// Runs every script named by target - a directory (its .simplic files) or a
+// text file listing one script path per line - on the worker pool, each in
+// its own Interpreter. Identical sources are compiled once. Each script's
+// output and a summary of status and wall time go to out, in listing order.
+// The memory counters are shared by the whole process, so a script calling
+// memstats() is an error unless opts.mem_stats is set. Returns the number of
+// scripts that did not finish cleanly.
+size_t run_batch(const std::string &target, const BatchOptions &opts, std::ostream &out);
@@ -0,0 +1,49 @@
+// binfile.cpp
+// Memory-mapped reading of whole files, for the compiled program cache and
+// snapshots (see binfile.hpp)
+
+#include "binfile.hpp"
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string &path) {
+#if defined(_WIN32)
+    HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (f == INVALID_HANDLE_VALUE) return;
+    file = f;
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(f, &sz) || sz.QuadPart == 0) return;
+    HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m) return;
+    mapping = m;
+    data = static_cast<const char *>(MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0));
+    if (data) size = (size_t)sz.QuadPart;
+#else
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) return;
+    void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) return;
+    data = static_cast<const char *>(p);
+    size = (size_t)st.st_size;
+#endif
+}
+
+MappedFile::~MappedFile() {
+#if defined(_WIN32)
+    if (data) UnmapViewOfFile(data);
+    if (mapping) CloseHandle(mapping);
+    if (file) CloseHandle(file);
+#else
+    if (data) munmap(const_cast<char *>(data), size);
+    if (fd >= 0) close(fd);
+#endif
+}
@@ -0,0 +1,115 @@
+// SimpliC Language - Binary Files (compiled program cache, snapshots)
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+inline uint64_t fnv1a(const char *p, size_t n, uint64_t h = 14695981039346656037ULL) {
+    for (size_t k = 0; k < n; ++k) {
+        h ^= (unsigned char)p[k];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Appends varints, zigzag ints, raw doubles and length-prefixed strings
+class ByteWriter {
+public:
+    std::string out;
+
+    void u(uint64_t v) {
+        while (v >= 0x80) {
+            out += (char)(v | 0x80);
+            v >>= 7;
+        }
+        out += (char)v;
+    }
+    void i(int v) { u((uint64_t)(((int64_t)v << 1) ^ ((int64_t)v >> 63))); }
+    void d(double v) { raw(&v, sizeof(double)); }
+    void s(const std::string &v) {
+        u(v.size());
+        out += v;
+    }
+    void raw(const void *p, size_t n) { out.append(static_cast<const char *>(p), n); }
+};
+
+// Reads what ByteWriter wrote; every read is bounds checked, so a damaged
+// file throws runtime_error (prefixed with what) instead of crashing
+class ByteReader {
+public:
+    ByteReader(const char *data, size_t size, const char *what) : p(data), end(data + size), what(what) {}
+
+    bool done() const { return p == end; }
+
+    uint64_t u() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            need(1);
+            unsigned char b = (unsigned char)*p++;
+            v |= (uint64_t)(b & 0x7f) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        fail("bad number");
+        return 0;
+    }
+    int i() {
+        uint64_t z = u();
+        return (int)((int64_t)(z >> 1) ^ -(int64_t)(z & 1));
+    }
+    double d() {
+        double v;
+        std::memcpy(&v, raw(sizeof(double)), sizeof(double));
+        return v;
+    }
+    std::string s() {
+        uint64_t n = u();
+        return std::string(raw(n), (size_t)n);
+    }
+    size_t count() {
+        uint64_t n = u();
+        // Every element takes at least a byte
+        if (n > (uint64_t)(end - p)) fail("bad count");
+        return (size_t)n;
+    }
+    // The next n bytes, in place
+    const char *raw(uint64_t n) {
+        need(n);
+        const char *at = p;
+        p += n;
+        return at;
+    }
+
+    [[noreturn]] void fail(const std::string &why) const { throw std::runtime_error(std::string(what) + ": " + why); }
+
+private:
+    const char *p, *end;
+    const char *what;
+
+    void need(uint64_t n) {
+        if (n > (uint64_t)(end - p)) fail("file is cut short");
+    }
+};
+
+// A read-only view of a whole file, memory mapped where the OS allows;
+// data is null if the file is missing or empty (binfile.cpp)
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data = nullptr;
+    size_t size = 0;
+
+private:
+#if defined(_WIN32)
+    void *file = nullptr;     // HANDLE
+    void *mapping = nullptr;  // HANDLE
+#else
+    int fd = -1;
+#endif
+};
@@ -0,0 +1,372 @@
+// cache.cpp
+// On-disk cache of compiled programs. A cache file holds a header, the
+// source it was built from and the optimized syntax tree in a compact
+// binary form. Files are named by a hash of the source and the tree
+// format, mapped into memory on load and only used when the stored source
+// matches byte for byte. Once the folder holds more than kCacheLimit bytes
+// of programs, the ones used least recently are deleted.
+
+#include "interpreter.hpp"
+#include "binfile.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <direct.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+namespace {
+
+const char kMagic[8] = {'S', 'I', 'M', 'P', 'L', 'I', 'C', 'C'};
+// Bump whenever a cached tree would mean something different: fields added
+// to Expr or Stmt, enum values reordered, or a change to what the optimizer
+// or infer_types leave in the tree. Method ids are looked up by name on load
+// and need no bump.
+const uint32_t kFormatVersion = 5;
+// Catches added or removed node kinds, operators and constant types even
+// when the bump is forgotten
+const uint32_t kTreeLayout = (uint32_t)Expr::Kind::Subscript | (uint32_t)Stmt::Kind::Restore << 8 |
+                             (uint32_t)Op::Unknown << 16 | (uint32_t)Value::Type::Heap << 24;
+const uint64_t kCacheLimit = 64ull << 20;
+
+struct Header {
+    char magic[8];
+    uint32_t format;
+    uint32_t layout;
+    uint64_t source_size;
+    uint64_t tree_size;
+    uint64_t tree_hash;
+};
+
+// Writing
+
+class Writer : public ByteWriter {
+public:
+    void value(const Value &v) {
+        u((uint64_t)v.type);
+        switch (v.type) {
+            case Value::Type::Nil: break;
+            case Value::Type::Number: d(v.as_number()); break;
+            case Value::Type::Word: s(v.word_value.str()); break;
+            case Value::Type::YesNo: u(v.as_yesno() ? 1 : 0); break;
+            default: throw std::runtime_error("cache: constant of a type that cannot be stored");
+        }
+    }
+
+    void expr(const ExprPtr &e) {
+        if (!e) {
+            u(0);
+            return;
+        }
+        u((uint64_t)e->kind + 1);
+        i(e->line);
+        if (e->kind == Expr::Kind::Literal) value(e->literal);
+        s(e->name);
+        u((uint64_t)e->op);
+        u((e->parens ? 1 : 0) | (e->name_fallback ? 2 : 0) | (e->unboxed ? 4 : 0));
+        u(e->args.size());
+        for (auto &a : e->args) expr(a);
+    }
+
+    void block(const Block &b) {
+        u(b.size());
+        for (auto &st : b) stmt(*st);
+    }
+
+    void stmt(const Stmt &st) {
+        u((uint64_t)st.kind);
+        i(st.line);
+        s(st.name);
+        s(st.type);
+        expr(st.expr);
+        expr(st.expr2);
+        expr(st.expr3);
+        block(st.body);
+        block(st.else_body);
+        u((st.parallel ? 1 : 0) | (st.literal_list ? 2 : 0));
+        u(st.items.size());
+        for (auto &item : st.items) expr(item);
+        u(st.literal_values.size());
+        for (auto &v : st.literal_values) value(v);
+        u(st.literal_numbers.size());
+        for (double n : st.literal_numbers) d(n);
+        s(st.show_parts);
+    }
+};
+
+// Reading; a damaged file throws, and is then ignored
+
+class Reader : public ByteReader {
+public:
+    Reader(const char *data, size_t size) : ByteReader(data, size, "cache") {}
+
+    Value value() {
+        uint64_t type = u();
+        switch ((Value::Type)type) {
+            case Value::Type::Nil: return Value::make_nil();
+            case Value::Type::Number: return Value::from_number(d());
+            case Value::Type::Word: return Value::from_word(Text::intern(s()));
+            case Value::Type::YesNo: return Value::from_yesno(u() != 0);
+            default: fail("bad constant");
+        }
+    }
+
+    ExprPtr expr() {
+        uint64_t kind = u();
+        if (kind == 0) return nullptr;
+        if (kind - 1 > (uint64_t)Expr::Kind::Subscript) fail("bad expression");
+        auto e = std::make_shared<Expr>();
+        e->kind = (Expr::Kind)(kind - 1);
+        e->line = i();
+        if (e->kind == Expr::Kind::Literal) e->literal = value();
+        e->name = s();
+        uint64_t op = u();
+        if (op > (uint64_t)Op::Unknown) fail("bad operator");
+        e->op = (Op)op;
+        uint64_t flags = u();
+        e->parens = (flags & 1) != 0;
+        e->name_fallback = (flags & 2) != 0;
+        e->unboxed = (flags & 4) != 0;
+        e->args.resize(count());
+        for (auto &a : e->args) a = expr();
+        if (e->kind == Expr::Kind::Method) e->method = method_id(e->name);
+        return e;
+    }
+
+    Block block() {
+        Block b(count());
+        for (auto &st : b) st = stmt();
+        return b;
+    }
+
+    StmtPtr stmt() {
+        auto st = std::make_shared<Stmt>();
+        uint64_t kind = u();
+        if (kind > (uint64_t)Stmt::Kind::Restore) fail("bad statement");
+        st->kind = (Stmt::Kind)kind;
+        st->line = i();
+        st->name = s();
+        st->type = s();
+        st->expr = expr();
+        st->expr2 = expr();
+        st->expr3 = expr();
+        st->body = block();
+        st->else_body = block();
+        uint64_t flags = u();
+        st->parallel = (flags & 1) != 0;
+        st->literal_list = (flags & 2) != 0;
+        st->items.resize(count());
+        for (auto &item : st->items) item = expr();
+        st->literal_values.resize(count());
+        for (auto &v : st->literal_values) v = value();
+        st->literal_numbers.resize(count());
+        for (auto &n : st->literal_numbers) n = d();
+        st->show_parts = s();
+        return st;
+    }
+};
+
+void make_dir(const std::string &path) {
+#if defined(_WIN32)
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+// SIMPLIC_CACHE_DIR, else the user's cache folder; empty if there is none.
+// The folder is made if it doesn't exist yet.
+std::string cache_dir() {
+    const char *dir = std::getenv("SIMPLIC_CACHE_DIR");
+    if (dir && *dir) {
+        make_dir(dir);
+        return dir;
+    }
+#if defined(_WIN32)
+    const char *base = std::getenv("LOCALAPPDATA");
+    if (!base || !*base) return "";
+    std::string out = std::string(base) + "\\simplic";
+#else
+    std::string out;
+    const char *xdg = std::getenv("XDG_CACHE_HOME");
+    const char *home = std::getenv("HOME");
+    if (xdg && *xdg) out = xdg;
+    else if (home && *home) out = std::string(home) + "/.cache";
+    else return "";
+    make_dir(out);
+    out += "/simplic";
+#endif
+    make_dir(out);
+    return out;
+}
+
+unsigned long process_id() {
+#if defined(_WIN32)
+    return (unsigned long)GetCurrentProcessId();
+#else
+    return (unsigned long)getpid();
+#endif
+}
+
+std::string cache_path(const std::string &dir, const std::string &source) {
+    uint32_t stamp[2] = {kFormatVersion, kTreeLayout};
+    uint64_t h = fnv1a(reinterpret_cast<const char *>(stamp), sizeof(stamp));
+    h = fnv1a(source.data(), source.size(), h);
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.simc", (unsigned long long)h);
+    return dir + "/" + name;
+}
+
+// The cached program for source, or null if the file is missing, stale or
+// damaged
+std::shared_ptr<Program> load_cached(const std::string &path, const std::string &source) {
+    MappedFile file(path);
+    if (!file.data || file.size < sizeof(Header)) return nullptr;
+    Header h;
+    std::memcpy(&h, file.data, sizeof(Header));
+    if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0 || h.format != kFormatVersion) return nullptr;
+    if (h.source_size != source.size() || h.tree_size != file.size - sizeof(Header) - h.source_size) return nullptr;
+    const char *stored = file.data + sizeof(Header);
+    if (std::memcmp(stored, source.data(), source.size()) != 0) return nullptr;
+    const char *tree = stored + source.size();
+    if (fnv1a(tree, (size_t)h.tree_size) != h.tree_hash) return nullptr;
+
+    try {
+        Reader in(tree, (size_t)h.tree_size);
+        auto prog = std::make_shared<Program>();
+        prog->body = in.block();
+        prog->opt_report.resize(in.count());
+        for (auto &note : prog->opt_report) note = in.s();
+        prog->warnings.resize(in.count());
+        for (auto &warning : prog->warnings) warning = in.s();
+        prog->uses_memstats = in.u() != 0;
+        if (!in.done()) return nullptr;
+        return prog;
+    } catch (const std::exception &) {
+        return nullptr;
+    }
+}
+
+// Written to a temporary name first so a reader never sees half a file
+void store_cached(const std::string &path, const std::string &source, const Program &prog) {
+    Writer w;
+    try {
+        w.block(prog.body);
+    } catch (const std::exception &) {
+        return;
+    }
+    w.u(prog.opt_report.size());
+    for (auto &note : prog.opt_report) w.s(note);
+    w.u(prog.warnings.size());
+    for (auto &warning : prog.warnings) w.s(warning);
+    w.u(prog.uses_memstats ? 1 : 0);
+
+    Header h;
+    std::memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.format = kFormatVersion;
+    h.layout = kTreeLayout;
+    h.source_size = source.size();
+    h.tree_size = w.out.size();
+    h.tree_hash = fnv1a(w.out.data(), w.out.size());
+
+    std::string tmp = path + ".tmp" + std::to_string((unsigned long long)process_id()) + "-" +
+                      std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    FILE *f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return;
+    bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1 &&
+              std::fwrite(source.data(), 1, source.size(), f) == source.size() &&
+              std::fwrite(w.out.data(), 1, w.out.size(), f) == w.out.size();
+    ok = (std::fclose(f) == 0) && ok;
+    if (ok) {
+#if defined(_WIN32)
+        std::remove(path.c_str());  // rename does not replace on Windows
+#endif
+        ok = std::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+    if (!ok) std::remove(tmp.c_str());
+}
+
+// Marks a cached program as just used, so evict() keeps it longest
+void touch(const std::string &path) {
+#if defined(_WIN32)
+    _utime(path.c_str(), nullptr);
+#else
+    utime(path.c_str(), nullptr);
+#endif
+}
+
+struct CachedFile {
+    std::string path;
+    uint64_t size;
+    time_t used;
+};
+
+// The programs stored in dir
+std::vector<CachedFile> cached_files(const std::string &dir) {
+    std::vector<CachedFile> files;
+    auto add = [&](const std::string &name) {
+        if (name.size() < 5 || name.compare(name.size() - 5, 5, ".simc") != 0) return;
+        std::string path = dir + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0) files.push_back(CachedFile{path, (uint64_t)st.st_size, st.st_mtime});
+    };
+#if defined(_WIN32)
+    WIN32_FIND_DATAA found;
+    HANDLE h = FindFirstFileA((dir + "\\*.simc").c_str(), &found);
+    if (h == INVALID_HANDLE_VALUE) return files;
+    do {
+        add(found.cFileName);
+    } while (FindNextFileA(h, &found));
+    FindClose(h);
+#else
+    DIR *d = opendir(dir.c_str());
+    if (!d) return files;
+    while (dirent *entry = readdir(d)) add(entry->d_name);
+    closedir(d);
+#endif
+    return files;
+}
+
+// Deletes the least recently used programs until the rest fit in
+// kCacheLimit; another process may be deleting the same files, which is fine
+void evict(const std::string &dir) {
+    std::vector<CachedFile> files = cached_files(dir);
+    uint64_t total = 0;
+    for (auto &f : files) total += f.size;
+    if (total <= kCacheLimit) return;
+    std::sort(files.begin(), files.end(), [](const CachedFile &a, const CachedFile &b) { return a.used < b.used; });
+    for (auto &f : files) {
+        if (total <= kCacheLimit) break;
+        std::remove(f.path.c_str());
+        total -= f.size;
+    }
+}
+
+} // namespace
+
+std::shared_ptr<const Program> Interpreter::compile_cached(const std::string &source) {
+    std::string dir = cache_dir();
+    if (dir.empty()) return compile(source);
+    std::string path = cache_path(dir, source);
+    if (auto prog = load_cached(path, source)) {
+        touch(path);
+        return prog;
+    }
+    auto prog = compile(source);
+    store_cached(path, source, *prog);
+    evict(dir);
+    return prog;
+}
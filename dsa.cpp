@@ -3,39 +3,106 @@
 
 #include "dsa.hpp"
 #include "simplic.hpp"
+#include <thread>
 
 // Stack
 void Stack::push(const Value &v) {
-    data.push(v);
+    data.push_back(v);
 }
 
 Value Stack::pop() {
     if (data.empty()) return Value::make_nil();
-    Value v = data.top();
-    data.pop();
+    Value v = std::move(data.back());
+    data.pop_back();
     return v;
 }
 
 Value Stack::top() const {
     if (data.empty()) return Value::make_nil();
-    return data.top();
+    return data.back();
+}
+
+Value Stack::peek(size_t k) const {
+    if (k >= data.size()) return Value::make_nil();
+    return data[data.size() - 1 - k];
+}
+
+void Stack::reserve(size_t n) {
+    size_t cap = 16;
+    while (cap < n) cap *= 2;
+    data.reserve(cap);
 }
 
 // Queue
+static size_t ring_capacity(size_t n) {
+    size_t cap = 16;
+    while (cap < n) cap *= 2;
+    return cap;
+}
+
+// Re-lays the items out from slot 0 in a buffer of at least min_capacity
+void Queue::grow(size_t min_capacity) {
+    size_t h = head.load(std::memory_order_relaxed), t = tail.load(std::memory_order_relaxed);
+    std::vector<Value> bigger(ring_capacity(min_capacity));
+    size_t mask = buf.size() - 1;
+    for (size_t k = h; k != t; ++k) bigger[k - h] = std::move(buf[k & mask]);
+    buf.swap(bigger);
+    head.store(0, std::memory_order_relaxed);
+    tail.store(t - h, std::memory_order_relaxed);
+}
+
+bool Queue::try_push(const Value &v) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t h = head.load(std::memory_order_acquire);
+    if (t - h == buf.size()) {
+        if (spsc) return false;
+        grow(buf.size() * 2);
+        t = tail.load(std::memory_order_relaxed);
+    }
+    buf[t & (buf.size() - 1)] = v;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+}
+
 void Queue::push(const Value &v) {
-    data.push(v);
+    while (!try_push(v)) std::this_thread::yield();
+}
+
+bool Queue::try_pop(Value &out) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) return false;
+    Value &slot = buf[h & (buf.size() - 1)];
+    out = std::move(slot);
+    slot = Value();
+    head.store(h + 1, std::memory_order_release);
+    return true;
 }
 
 Value Queue::pop() {
-    if (data.empty()) return Value::make_nil();
-    Value v = data.front();
-    data.pop();
+    Value v;
+    try_pop(v);
     return v;
 }
 
 Value Queue::front() const {
-    if (data.empty()) return Value::make_nil();
-    return data.front();
+    return peek(0);
+}
+
+Value Queue::peek(size_t k) const {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (k >= tail.load(std::memory_order_acquire) - h) return Value::make_nil();
+    return buf[(h + k) & (buf.size() - 1)];
+}
+
+void Queue::reserve(size_t n) {
+    if (!spsc && n > buf.size()) grow(n);
+}
+
+void Queue::make_spsc(size_t n) {
+    // With no room at all the producer would wait forever on its first push
+    if (n == 0) n = 1;
+    if (n > buf.size()) grow(n);
+    spsc = true;
 }
 
 // LinkedList
@@ -101,26 +168,32 @@ std::string SimpliSet::to_string() const {
     return ss.str();
 }
 
+// Key hashing for HashMap
+size_t hash_key(const std::string &s) {
+    size_t h = std::hash<std::string>()(s);
+    // Spread the bits so both the 7-bit tag and the group index are well mixed
+    return (size_t)((uint64_t)h * 0x9E3779B97F4A7C15ULL ^ ((uint64_t)h >> 29));
+}
+
 // Map
 void SimpliMap::set(const std::string &key, double val) {
     data[key] = val;
 }
 
 double SimpliMap::get(const std::string &key) const {
-    auto it = data.find(key);
-    if (it != data.end()) return it->second;
-    return 0.0;
+    const double *v = data.find(key);
+    return v ? *v : 0.0;
 }
 
 std::string SimpliMap::to_string() const {
     std::ostringstream ss;
     ss << "{";
     bool first = true;
-    for (auto &kv : data) {
+    data.each([&](const std::string &k, double v) {
         if (!first) ss << ", ";
-        ss << kv.first << ": " << kv.second;
+        ss << k << ": " << v;
         first = false;
-    }
+    });
     ss << "}";
     return ss.str();
 }
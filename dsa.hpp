@@ -2,37 +2,62 @@
 #pragma once
 
 #include <vector>
-#include <stack>
 #include <queue>
+#include <atomic>
 #include <set>
 #include <map>
 #include <unordered_map>
 #include <unordered_set>
 #include <algorithm>
 #include <sstream>
+#include <functional>
+#include <cstdint>
+#include "hashmap.hpp"
+#include "text.hpp"
 
 struct Value;
+struct Environment;
 
-// Stack - LIFO container
+// Stack - LIFO container on one contiguous array
 struct Stack {
-    std::stack<Value> data;
-    
+    std::vector<Value> data;
+
     void push(const Value &v);
     Value pop();
     Value top() const;
+    Value peek(size_t k) const;  // k-th from the top, 0 is the top
     size_t size() const { return data.size(); }
     bool empty() const { return data.empty(); }
+    void reserve(size_t n);
 };
 
-// Queue - FIFO container
+// Queue - FIFO ring buffer with a power-of-two capacity that doubles when
+// full. head and tail only ever count up; the slot is the count masked by
+// capacity - 1. Values are moved out when popped.
+//
+// In SPSC mode the capacity is fixed, and one producer thread may push while
+// one consumer thread pops without locks: each side only writes its own
+// index and publishes it with a release store.
 struct Queue {
-    std::queue<Value> data;
-    
-    void push(const Value &v);
+    std::vector<Value> buf;
+    std::atomic<size_t> head{0}, tail{0};
+    bool spsc = false;
+
+    void push(const Value &v);  // SPSC mode: waits while the queue is full
     Value pop();
+    bool try_push(const Value &v);
+    bool try_pop(Value &out);
     Value front() const;
-    size_t size() const { return data.size(); }
-    bool empty() const { return data.empty(); }
+    Value peek(size_t k) const;  // k-th from the front, 0 is the front
+    size_t size() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire); }
+    bool empty() const { return size() == 0; }
+    void reserve(size_t n);
+    // Fixes the capacity at (at least) n, and at least 1, and switches to
+    // SPSC mode
+    void make_spsc(size_t n);
+
+private:
+    void grow(size_t min_capacity);
 };
 
 // Linked List node
@@ -60,7 +85,7 @@ struct LinkedList {
 // Set wrapper
 struct SimpliSet {
     std::set<double> nums; // simplified: only numbers
-    std::set<std::string> words;
+    std::set<Text> words;
     
     void add(const Value &v);
     bool contains(const Value &v) const;
@@ -70,10 +95,12 @@ struct SimpliSet {
 
 // Map wrapper (string keys, store double for simplicity)
 struct SimpliMap {
-    std::unordered_map<std::string, double> data;
+    HashMap<double> data;
     
     void set(const std::string &key, double val);
     double get(const std::string &key) const;
+    bool has(const std::string &key) const { return data.contains(key); }
+    bool remove(const std::string &key) { return data.erase(key); }
     size_t size() const { return data.size(); }
     std::string to_string() const;
 };
@@ -115,3 +142,91 @@ struct Graph {
     void dfs_helper(int node, std::unordered_set<int> &visited, std::vector<int> &result) const;
     std::string to_string() const;
 };
+
+// Typed numeric array - contiguous doubles with vectorized kernels
+// (implemented in numeric.cpp, AVX2/SSE2 picked at runtime)
+struct NumArray {
+    std::vector<double> data;
+
+    size_t size() const { return data.size(); }
+    double sum() const;
+    // min and max are NaN when the array holds a NaN, whichever kernel runs
+    double min() const;
+    double max() const;
+    double mean() const;
+    // dot, plus and times with another array throw runtime_error when the
+    // lengths differ
+    double dot(const NumArray &other) const;
+    NumArray plus(double k) const;
+    NumArray times(double k) const;
+    NumArray plus(const NumArray &other) const;
+    NumArray times(const NumArray &other) const;
+    NumArray prefix_sum() const;
+    std::string to_string() const;
+};
+
+// Heap - priority queue on a 4-ary array heap (heap.cpp). Items live in
+// fixed slots; the heap array only holds slot numbers, so sifting moves
+// 4-byte ids instead of Values. Number keys are also kept in a flat array
+// and compared directly. A handle names a slot plus its reuse count, so a
+// handle to an item that has left the heap stays invalid.
+struct Heap {
+    bool max_first = false;                       // maxheap: largest key comes out first
+    std::function<Value(const Value &)> key_fn;   // empty: items are their own keys
+
+    size_t size() const { return heap.size(); }
+    bool empty() const { return heap.empty(); }
+    double push(const Value &item);               // returns the item's handle
+    Value pop();
+    Value peek() const;
+    void heapify(const std::vector<Value> &list); // replaces the contents in O(n)
+    // Replaces the item behind handle and moves it to its new place;
+    // false if the item is no longer in the heap
+    bool update(double handle, const Value &item);
+    // Takes the item behind handle out; false if it already left
+    bool remove(double handle);
+    std::vector<Value> items_in_order() const;
+    // Every value held, keys included, in no particular order
+    template <typename F> void each_value(F f) const {
+        for (auto &v : items) f(v);
+        for (auto &v : keys) f(v);
+    }
+
+private:
+    std::vector<Value> items, keys;
+    std::vector<double> num_keys;
+    bool numeric = true;            // every key so far was a number
+    std::vector<uint32_t> heap;     // slot ids in heap order
+    std::vector<uint32_t> pos;      // slot id -> index in heap
+    std::vector<uint32_t> gen;      // slot id -> times reused
+    std::vector<uint32_t> free_slots;
+
+    uint32_t store(const Value &item);
+    size_t index_of(double handle) const;
+    void set_key(uint32_t slot);
+    bool before(uint32_t a, uint32_t b) const;
+    void place(size_t i, uint32_t slot) { heap[i] = slot; pos[slot] = (uint32_t)i; }
+    void sift_up(size_t i);
+    void sift_down(size_t i);
+};
+
+// Sorting (sort.cpp)
+// compare_values is a total order over every Value type: nil < yesno <
+// number < word < list < numbers < other containers; NaN sorts last.
+int compare_values(const Value &a, const Value &b);
+void sort_list(std::vector<Value> &items, bool descending, bool stable);
+void sort_list_by_keys(std::vector<Value> &items, const std::vector<Value> &keys, bool descending);
+// sort_doubles keeps every double bit for bit: -0.0 stays -0.0 and NaNs keep
+// their payloads (the radix path may put -0.0 just before 0.0).
+void sort_doubles(std::vector<double> &data, bool descending);
+
+// Bulk data files (io.cpp)
+// kind is list, numbers, lines, map or graph; errors throw runtime_error
+Value load_file(const std::string &kind, const std::string &path);
+void save_value(const Value &v, const std::string &path);
+
+// Snapshots (snapshot.cpp)
+// Writes every variable visible from env, and all it reaches, to path;
+// restore_snapshot sets them in env again. Functions are not saved.
+void save_snapshot(const Environment &env, const std::string &path);
+void restore_snapshot(Environment &env, const std::string &path);
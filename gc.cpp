@@ -0,0 +1,248 @@
+// gc.cpp
+// Cycle collector over the containers and shared scopes of one Interpreter:
+// trial deletion on shared_ptr use counts (see gc.hpp)
+
+#include "gc.hpp"
+#include "interpreter.hpp"
+#include "dsa.hpp"
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+
+thread_local Collector *current_collector = nullptr;
+
+namespace {
+
+enum NodeKind { kList, kMap, kStack, kQueue, kHeap, kSequence, kScope };
+
+// Calls f with each tracked-kind object v holds a strong reference to
+template <typename F>
+void each_ref(const Value &v, F f) {
+    if (v.list_value) f(v.list_value.get());
+    if (v.map_value) f(v.map_value.get());
+    if (v.stack_value) f(v.stack_value.get());
+    if (v.queue_value) f(v.queue_value.get());
+    if (v.heap_value) f(v.heap_value.get());
+    if (v.seq_value) f(v.seq_value.get());
+    if (v.func_env) f(v.func_env.get());
+}
+
+// Calls f with every value a node holds, and every scope it owns directly
+template <typename F>
+void each_child(int kind, void *obj, F f) {
+    auto each_value = [&f](const Value &v) { each_ref(v, f); };
+    switch (kind) {
+        case kList:
+            for (auto &v : *static_cast<List *>(obj)) each_value(v);
+            break;
+        case kMap:
+            static_cast<Map *>(obj)->each([&](const std::string &, const Value &v) { each_value(v); });
+            break;
+        case kStack:
+            for (auto &v : static_cast<Stack *>(obj)->data) each_value(v);
+            break;
+        case kQueue:
+            for (auto &v : static_cast<Queue *>(obj)->buf) each_value(v);
+            break;
+        case kHeap:
+            static_cast<Heap *>(obj)->each_value(each_value);
+            break;
+        case kSequence: {
+            auto *seq = static_cast<Sequence *>(obj);
+            each_value(seq->source);
+            for (auto &stage : seq->stages) each_value(stage.second);
+            break;
+        }
+        case kScope: {
+            auto *env = static_cast<Environment *>(obj);
+            for (auto &kv : env->vars) each_value(kv.second);
+            if (env->keep_parent) f(env->keep_parent.get());
+            break;
+        }
+    }
+}
+
+// Drops everything a garbage node holds
+void empty_node(int kind, void *obj) {
+    switch (kind) {
+        case kList: static_cast<List *>(obj)->clear(); break;
+        case kMap: static_cast<Map *>(obj)->clear(); break;
+        case kStack: static_cast<Stack *>(obj)->data.clear(); break;
+        case kQueue: {
+            auto *q = static_cast<Queue *>(obj);
+            for (auto &v : q->buf) v = Value();
+            break;
+        }
+        case kHeap: {
+            auto *h = static_cast<Heap *>(obj);
+            h->heapify(List());
+            h->key_fn = nullptr;
+            break;
+        }
+        case kSequence: {
+            auto *seq = static_cast<Sequence *>(obj);
+            seq->source = Value();
+            seq->stages.clear();
+            break;
+        }
+        case kScope: {
+            auto *env = static_cast<Environment *>(obj);
+            env->vars.clear();
+            env->keep_parent.reset();
+            break;
+        }
+    }
+}
+
+// Rough size of a node and what it holds directly
+size_t node_bytes(int kind, void *obj) {
+    switch (kind) {
+        case kList: return sizeof(List) + static_cast<List *>(obj)->capacity() * sizeof(Value);
+        case kMap: return sizeof(Map) + static_cast<Map *>(obj)->size() * (sizeof(Value) + 40);
+        case kStack: return sizeof(Stack) + static_cast<Stack *>(obj)->data.capacity() * sizeof(Value);
+        case kQueue: return sizeof(Queue) + static_cast<Queue *>(obj)->buf.capacity() * sizeof(Value);
+        case kHeap: return sizeof(Heap) + static_cast<Heap *>(obj)->size() * (2 * sizeof(Value) + 24);
+        case kSequence: return sizeof(Sequence) + static_cast<Sequence *>(obj)->stages.size() * sizeof(Value);
+        case kScope: return sizeof(Environment) + static_cast<Environment *>(obj)->vars.size() * (sizeof(Value) + 48);
+    }
+    return 0;
+}
+
+} // namespace
+
+void gc_adopt(const Value &v) {
+    current_collector->track(v);
+}
+
+void gc_adopt(const std::shared_ptr<Environment> &env) {
+    current_collector->track(env);
+}
+
+void Collector::track(const Value &v) {
+    switch (v.type) {
+        case Value::Type::List: add(kList, v.list_value, v.list_value.get()); break;
+        case Value::Type::Map: add(kMap, v.map_value, v.map_value.get()); break;
+        case Value::Type::Stack: add(kStack, v.stack_value, v.stack_value.get()); break;
+        case Value::Type::Queue: add(kQueue, v.queue_value, v.queue_value.get()); break;
+        case Value::Type::Heap: add(kHeap, v.heap_value, v.heap_value.get()); break;
+        case Value::Type::Sequence: add(kSequence, v.seq_value, v.seq_value.get()); break;
+        default: break;
+    }
+}
+
+void Collector::track(const std::shared_ptr<Environment> &env) {
+    add(kScope, env, env.get());
+}
+
+void Collector::add(int kind, std::weak_ptr<void> ref, void *obj) {
+    std::lock_guard<std::mutex> lock(m);
+    nodes.push_back(Node{kind, std::move(ref), obj});
+    since_last.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Collector::collect(bool enforce_limit) {
+    auto started = std::chrono::steady_clock::now();
+    std::vector<std::shared_ptr<void>> garbage;
+    long long live_bytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(m);
+
+        // Drop the dead and the duplicates
+        std::unordered_map<void *, size_t> index;
+        size_t n = 0;
+        for (auto &node : nodes) {
+            if (node.ref.expired() || !index.insert(std::make_pair(node.obj, n)).second) continue;
+            if (&nodes[n] != &node) nodes[n] = std::move(node);
+            ++n;
+        }
+        nodes.resize(n);
+
+        // Use counts minus the references from other tracked objects
+        std::vector<long> outside(n);
+        for (size_t k = 0; k < n; ++k) outside[k] = nodes[k].ref.use_count();
+        for (size_t k = 0; k < n; ++k) {
+            each_child(nodes[k].kind, nodes[k].obj, [&](void *child) {
+                auto it = index.find(child);
+                if (it != index.end()) --outside[it->second];
+            });
+        }
+
+        // Everything reachable from an outside reference stays
+        std::vector<char> reached(n, 0);
+        std::vector<size_t> work;
+        for (size_t k = 0; k < n; ++k) {
+            if (outside[k] > 0) {
+                reached[k] = 1;
+                work.push_back(k);
+            }
+        }
+        while (!work.empty()) {
+            size_t k = work.back();
+            work.pop_back();
+            each_child(nodes[k].kind, nodes[k].obj, [&](void *child) {
+                auto it = index.find(child);
+                if (it != index.end() && !reached[it->second]) {
+                    reached[it->second] = 1;
+                    work.push_back(it->second);
+                }
+            });
+        }
+
+        // Hold all the garbage first, so nothing is freed while it is being
+        // emptied; the last holds go once the lock is released
+        for (size_t k = 0; k < n; ++k) {
+            if (!reached[k]) garbage.push_back(nodes[k].ref.lock());
+        }
+        size_t kept = 0;
+        for (size_t k = 0; k < n; ++k) {
+            if (reached[k]) {
+                live_bytes += (long long)node_bytes(nodes[k].kind, nodes[k].obj);
+                if (kept != k) nodes[kept] = std::move(nodes[k]);
+                ++kept;
+            } else {
+                empty_node(nodes[k].kind, nodes[k].obj);
+            }
+        }
+        nodes.resize(kept);
+        since_last.store(0, std::memory_order_relaxed);
+        // Collect again once as many new objects have come as survived
+        threshold = std::max<size_t>(1000, kept);
+    }
+    long long freed = (long long)garbage.size();
+    garbage.clear();
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    {
+        std::lock_guard<std::mutex> lock(m);
+        totals.collections += 1;
+        totals.freed += freed;
+        totals.live = (long long)nodes.size();
+        totals.live_bytes = live_bytes;
+        totals.pause_ms += ms;
+        totals.max_pause_ms = std::max(totals.max_pause_ms, ms);
+    }
+
+    if (enforce_limit && heap_limit && (size_t)live_bytes > heap_limit) {
+        throw RunLimitError("heap limit of " + std::to_string(heap_limit) + " bytes exceeded (" +
+                            std::to_string(live_bytes) + " bytes live)", RunLimitError::Limit::Heap);
+    }
+}
+
+void Collector::release_scopes() {
+    std::vector<std::shared_ptr<void>> held;
+    {
+        std::lock_guard<std::mutex> lock(m);
+        for (auto &node : nodes) {
+            if (node.kind == kScope) held.push_back(node.ref.lock());
+        }
+        for (auto &node : nodes) {
+            if (node.kind == kScope && !node.ref.expired()) empty_node(node.kind, node.obj);
+        }
+    }
+    held.clear();
+}
+
+GcStats Collector::stats() const {
+    std::lock_guard<std::mutex> lock(m);
+    return totals;
+}
@@ -0,0 +1,67 @@
+// SimpliC Language - Cycle Collector
+#pragma once
+
+#include "simplic.hpp"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+struct GcStats {
+    long long collections = 0;
+    long long freed = 0;            // objects whose cycles were broken
+    long long live = 0;             // tracked objects left after the last collection
+    long long live_bytes = 0;       // their estimated size
+    double pause_ms = 0;            // all collections together
+    double max_pause_ms = 0;
+};
+
+// Finds garbage cycles among the containers and shared scopes made while an
+// Interpreter runs. Reference counting already frees everything else; what
+// it cannot free is a group of objects that only point at each other.
+//
+// A collection is trial deletion: every tracked object starts with its
+// shared_ptr use count, each reference from another tracked object is
+// subtracted, and whatever is left over comes from outside - environments
+// on the C++ stack, values held by running statements, the host. Objects
+// reachable from those survive; the rest are emptied, which breaks their
+// cycles and lets reference counting free them. References the collector
+// cannot see (inside native closures) only ever keep objects alive.
+//
+// Collections run between statements on the interpreter's own thread, never
+// while a parallel loop is running.
+class Collector {
+public:
+    void track(const Value &v);
+    void track(const std::shared_ptr<Environment> &env);
+
+    // Enough new objects since the last collection to be worth another
+    bool due() const { return since_last.load(std::memory_order_relaxed) >= threshold; }
+    // Collects; with enforce_limit set, throws RunLimitError if the live
+    // objects are still over the heap limit afterwards
+    void collect(bool enforce_limit = true);
+    // Empties every scope still tracked; for when the Interpreter goes away,
+    // since nothing can run in those scopes after that
+    void release_scopes();
+
+    void set_heap_limit(size_t bytes) { heap_limit = bytes; }
+    GcStats stats() const;
+
+private:
+    struct Node {
+        int kind;
+        std::weak_ptr<void> ref;
+        void *obj;
+    };
+
+    mutable std::mutex m;
+    std::vector<Node> nodes;
+    std::atomic<size_t> since_last{0};
+    size_t threshold = 1000;
+    size_t heap_limit = 0;
+    GcStats totals;
+
+    void add(int kind, std::weak_ptr<void> ref, void *obj);
+};
+
+// The collector of the Interpreter running on this thread, if any
+extern thread_local Collector *current_collector;
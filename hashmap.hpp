@@ -0,0 +1,221 @@
+// SimpliC Language - Open-Addressing Hash Map
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMPLIC_HASHMAP_SSE2 1
+#endif
+
+// A key stored in its entry, with its hash computed once
+struct StoredKey {
+    std::string str;
+    size_t hash = 0;
+};
+
+size_t hash_key(const std::string &s);
+
+namespace hashmap_detail {
+
+const uint8_t kEmpty = 0x80;
+const uint8_t kDeleted = 0xFE;
+const size_t kGroupWidth = 16;
+
+// Bitmask of the bytes in a 16-byte control group equal to tag
+inline uint32_t group_match(const uint8_t *group, uint8_t tag) {
+#ifdef SIMPLIC_HASHMAP_SSE2
+    __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)tag)));
+#else
+    uint32_t mask = 0;
+    for (size_t k = 0; k < kGroupWidth; ++k) {
+        if (group[k] == tag) mask |= 1u << k;
+    }
+    return mask;
+#endif
+}
+
+inline int lowest_bit(uint32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(mask);
+#else
+    int k = 0;
+    while (!(mask & 1u)) { mask >>= 1; ++k; }
+    return k;
+#endif
+}
+
+} // namespace hashmap_detail
+
+// Swiss-table style map from strings to V. A control byte per slot holds a
+// 7-bit hash tag so a probe checks 16 slots at once; slots point into a dense
+// entry array, which keeps iteration in insertion order.
+template <typename V>
+struct HashMap {
+    struct Entry {
+        StoredKey key;
+        V value;
+        bool live;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<uint8_t> ctrl;
+    std::vector<uint32_t> slots;
+    size_t count = 0;
+    size_t used_slots = 0; // full + deleted control bytes
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    void clear() {
+        entries.clear();
+        ctrl.clear();
+        slots.clear();
+        count = 0;
+        used_slots = 0;
+    }
+
+    V *find(const std::string &key) {
+        size_t slot = find_slot(key, hash_key(key));
+        return slot == npos() ? nullptr : &entries[slots[slot]].value;
+    }
+
+    const V *find(const std::string &key) const {
+        size_t slot = find_slot(key, hash_key(key));
+        return slot == npos() ? nullptr : &entries[slots[slot]].value;
+    }
+
+    bool contains(const std::string &key) const { return find(key) != nullptr; }
+
+    // Returns the value for key, inserting a default one if missing
+    V &operator[](const std::string &key) {
+        size_t h = hash_key(key);
+        size_t slot = find_slot(key, h);
+        if (slot != npos()) return entries[slots[slot]].value;
+        return insert_new(key, h, V());
+    }
+
+    void set(const std::string &key, const V &val) { (*this)[key] = val; }
+
+    bool erase(const std::string &key) {
+        size_t slot = find_slot(key, hash_key(key));
+        if (slot == npos()) return false;
+        Entry &e = entries[slots[slot]];
+        e.live = false;
+        e.value = V();
+        std::string().swap(e.key.str);
+        ctrl[slot] = hashmap_detail::kDeleted;
+        --count;
+        // Compact once dead entries dominate so iteration stays cheap
+        if (entries.size() > 16 && count * 2 < entries.size()) rehash(capacity());
+        return true;
+    }
+
+    std::vector<std::string> keys() const {
+        std::vector<std::string> out;
+        out.reserve(count);
+        for (auto &e : entries) {
+            if (e.live) out.push_back(e.key.str);
+        }
+        return out;
+    }
+
+    // Iteration over live entries in insertion order
+    template <typename F>
+    void each(F f) const {
+        for (auto &e : entries) {
+            if (e.live) f(e.key.str, e.value);
+        }
+    }
+
+    void reserve(size_t n) {
+        size_t cap = hashmap_detail::kGroupWidth;
+        while (cap * 7 / 8 < n) cap *= 2;
+        if (cap > capacity()) rehash(cap);
+    }
+
+private:
+    static size_t npos() { return (size_t)-1; }
+    size_t capacity() const { return ctrl.size(); }
+
+    // Low 7 bits pick the tag, the rest pick the starting group
+    static uint8_t tag_of(size_t h) { return (uint8_t)(h & 0x7F); }
+
+    size_t find_slot(const std::string &key, size_t h) const {
+        if (ctrl.empty()) return npos();
+        size_t groups = capacity() / hashmap_detail::kGroupWidth;
+        size_t g = (h >> 7) & (groups - 1);
+        uint8_t tag = tag_of(h);
+        for (size_t step = 1; step <= groups; ++step) {
+            const uint8_t *group = &ctrl[g * hashmap_detail::kGroupWidth];
+            uint32_t match = hashmap_detail::group_match(group, tag);
+            while (match) {
+                size_t slot = g * hashmap_detail::kGroupWidth + hashmap_detail::lowest_bit(match);
+                const Entry &e = entries[slots[slot]];
+                if (e.key.hash == h && e.key.str == key) return slot;
+                match &= match - 1;
+            }
+            if (hashmap_detail::group_match(group, hashmap_detail::kEmpty)) return npos();
+            g = (g + step) & (groups - 1);
+        }
+        return npos();
+    }
+
+    // First empty or deleted slot along the probe sequence of h
+    size_t free_slot(size_t h) const {
+        size_t groups = capacity() / hashmap_detail::kGroupWidth;
+        size_t g = (h >> 7) & (groups - 1);
+        for (size_t step = 1;; ++step) {
+            const uint8_t *group = &ctrl[g * hashmap_detail::kGroupWidth];
+            for (size_t k = 0; k < hashmap_detail::kGroupWidth; ++k) {
+                if (group[k] & 0x80) return g * hashmap_detail::kGroupWidth + k;
+            }
+            g = (g + step) & (groups - 1);
+        }
+    }
+
+    V &insert_new(const std::string &key, size_t h, const V &val) {
+        if ((used_slots + 1) * 8 > capacity() * 7) {
+            size_t cap = capacity() ? capacity() : hashmap_detail::kGroupWidth;
+            while ((count + 1) * 8 > cap * 7 / 2) cap *= 2;
+            rehash(cap);
+        }
+        size_t slot = free_slot(h);
+        if (ctrl[slot] == hashmap_detail::kEmpty) ++used_slots;
+        ctrl[slot] = tag_of(h);
+        slots[slot] = (uint32_t)entries.size();
+        Entry e;
+        e.key.str = key;
+        e.key.hash = h;
+        e.value = val;
+        e.live = true;
+        entries.push_back(std::move(e));
+        ++count;
+        return entries.back().value;
+    }
+
+    // Rebuilds the control bytes at cap slots, dropping dead entries
+    void rehash(size_t cap) {
+        std::vector<Entry> live;
+        live.reserve(count);
+        for (auto &e : entries) {
+            if (e.live) live.push_back(std::move(e));
+        }
+        entries.swap(live);
+        ctrl.assign(cap, hashmap_detail::kEmpty);
+        slots.assign(cap, 0);
+        used_slots = 0;
+        for (size_t idx = 0; idx < entries.size(); ++idx) {
+            size_t slot = free_slot(entries[idx].key.hash);
+            ctrl[slot] = tag_of(entries[idx].key.hash);
+            slots[slot] = (uint32_t)idx;
+            ++used_slots;
+        }
+    }
+};
@@ -0,0 +1,210 @@
+// heap.cpp
+// Priority queue: a 4-ary array heap over slot ids. Four children per node
+// halve the depth of a binary heap and keep siblings in one cache line.
+
+#include "simplic.hpp"
+#include "dsa.hpp"
+#include <cmath>
+
+namespace {
+
+const size_t kArity = 4;
+const double kSlotSpace = 4294967296.0;  // handle = reuse count * 2^32 + slot
+
+} // namespace
+
+// Numbers compare the way compare_values orders them: NaN last
+static bool number_before(double a, double b) {
+    if (std::isnan(a)) return false;
+    if (std::isnan(b)) return true;
+    return a < b;
+}
+
+bool Heap::before(uint32_t a, uint32_t b) const {
+    if (numeric) {
+        return max_first ? number_before(num_keys[b], num_keys[a]) : number_before(num_keys[a], num_keys[b]);
+    }
+    const Value &ka = key_fn ? keys[a] : items[a];
+    const Value &kb = key_fn ? keys[b] : items[b];
+    int c = compare_values(ka, kb);
+    return max_first ? c > 0 : c < 0;
+}
+
+void Heap::set_key(uint32_t slot) {
+    if (key_fn) keys[slot] = key_fn(items[slot]);
+    const Value &k = key_fn ? keys[slot] : items[slot];
+    if (k.type == Value::Type::Number) num_keys[slot] = k.as_number();
+    else numeric = false;
+}
+
+// Puts item in a free slot (or a new one) and returns the slot id
+uint32_t Heap::store(const Value &item) {
+    uint32_t slot;
+    if (!free_slots.empty()) {
+        slot = free_slots.back();
+        free_slots.pop_back();
+        ++gen[slot];
+    } else {
+        slot = (uint32_t)items.size();
+        items.push_back(Value());
+        keys.push_back(Value());
+        num_keys.push_back(0);
+        pos.push_back(0);
+        gen.push_back(0);
+    }
+    items[slot] = item;
+    set_key(slot);
+    return slot;
+}
+
+void Heap::sift_up(size_t i) {
+    uint32_t slot = heap[i];
+    while (i > 0) {
+        size_t parent = (i - 1) / kArity;
+        if (!before(slot, heap[parent])) break;
+        place(i, heap[parent]);
+        i = parent;
+    }
+    place(i, slot);
+}
+
+void Heap::sift_down(size_t i) {
+    uint32_t slot = heap[i];
+    size_t n = heap.size();
+    while (true) {
+        size_t first = i * kArity + 1;
+        if (first >= n) break;
+        size_t last = std::min(first + kArity, n);
+        size_t best = first;
+        for (size_t c = first + 1; c < last; ++c) {
+            if (before(heap[c], heap[best])) best = c;
+        }
+        if (!before(heap[best], slot)) break;
+        place(i, heap[best]);
+        i = best;
+    }
+    place(i, slot);
+}
+
+double Heap::push(const Value &item) {
+    uint32_t slot = store(item);
+    heap.push_back(slot);
+    sift_up(heap.size() - 1);
+    return gen[slot] * kSlotSpace + slot;
+}
+
+Value Heap::peek() const {
+    if (heap.empty()) return Value::make_nil();
+    return items[heap[0]];
+}
+
+Value Heap::pop() {
+    if (heap.empty()) return Value::make_nil();
+    uint32_t top = heap[0];
+    Value out = std::move(items[top]);
+    items[top] = Value();
+    if (key_fn) keys[top] = Value();
+    free_slots.push_back(top);
+
+    uint32_t last = heap.back();
+    heap.pop_back();
+    if (!heap.empty()) {
+        place(0, last);
+        sift_down(0);
+    } else {
+        // Empty again: non-number keys are gone, so the fast path can return
+        numeric = true;
+    }
+    return out;
+}
+
+// Bottom-up construction: sift down every parent, last one first
+void Heap::heapify(const std::vector<Value> &list) {
+    items.clear();
+    keys.clear();
+    num_keys.clear();
+    pos.clear();
+    free_slots.clear();
+    heap.clear();
+    numeric = true;
+    // Every handle given out before stays invalid: reuse counts carry on
+    std::vector<uint32_t> old_gen;
+    old_gen.swap(gen);
+
+    items.reserve(list.size());
+    heap.reserve(list.size());
+    for (auto &item : list) {
+        uint32_t slot = store(item);
+        if (slot < old_gen.size()) gen[slot] = old_gen[slot] + 1;
+        heap.push_back(slot);
+        pos[slot] = (uint32_t)(heap.size() - 1);
+    }
+    for (size_t k = list.size(); k < old_gen.size(); ++k) {
+        // Slots past the new contents keep counting so old handles miss
+        items.push_back(Value());
+        keys.push_back(Value());
+        num_keys.push_back(0);
+        pos.push_back(0);
+        gen.push_back(old_gen[k] + 1);
+        free_slots.push_back((uint32_t)k);
+    }
+    if (heap.size() > 1) {
+        for (size_t i = (heap.size() - 2) / kArity + 1; i-- > 0;) sift_down(i);
+    }
+}
+
+// Where the item behind handle sits in the heap array; heap.size() if the
+// handle is stale or was never given out
+size_t Heap::index_of(double handle) const {
+    if (!(handle >= 0)) return heap.size();
+    double g = std::floor(handle / kSlotSpace);
+    double s = handle - g * kSlotSpace;
+    if (s >= (double)items.size()) return heap.size();
+    uint32_t slot = (uint32_t)s;
+    if (gen[slot] != (uint32_t)g) return heap.size();
+    // A free slot is not in the heap
+    size_t i = pos[slot];
+    if (i >= heap.size() || heap[i] != slot) return heap.size();
+    return i;
+}
+
+bool Heap::update(double handle, const Value &item) {
+    size_t i = index_of(handle);
+    if (i >= heap.size()) return false;
+    uint32_t slot = heap[i];
+    items[slot] = item;
+    set_key(slot);
+    sift_up(i);
+    sift_down(pos[slot]);
+    return true;
+}
+
+// The last item fills the gap and moves up or down from there
+bool Heap::remove(double handle) {
+    size_t i = index_of(handle);
+    if (i >= heap.size()) return false;
+    uint32_t slot = heap[i];
+    items[slot] = Value();
+    if (key_fn) keys[slot] = Value();
+    free_slots.push_back(slot);
+
+    uint32_t last = heap.back();
+    heap.pop_back();
+    if (i < heap.size()) {
+        place(i, last);
+        sift_up(i);
+        sift_down(pos[last]);
+    } else if (heap.empty()) {
+        numeric = true;
+    }
+    return true;
+}
+
+// Items in the order pop would return them, without changing the heap
+std::vector<Value> Heap::items_in_order() const {
+    Heap copy(*this);
+    std::vector<Value> out;
+    out.reserve(heap.size());
+    while (!copy.empty()) out.push_back(copy.pop());
+    return out;
+}
@@ -0,0 +1,318 @@
+// infer.cpp
+// Type inference over a parsed program, run last by optimize_program:
+//  - works out which names only ever hold numbers, words or yesno values,
+//    from every make, loop, reduction and define that binds them, and the
+//    types define'd functions are called with and give back
+//  - marks arithmetic and comparisons whose operands are all numbers as
+//    unboxed, so the interpreter runs them on plain doubles
+//  - records operations that can only give nil, and declared types that do
+//    not match their initializer, as warnings shown before the program runs
+// Names are tracked program-wide rather than per scope: every binding of a
+// name counts, so the result holds in whichever scope a read finds it.
+
+#include "ast.hpp"
+#include <map>
+#include <set>
+
+namespace {
+
+// Unknown: nothing seen yet; Any: more than one type, or one not tracked
+enum class Static { Unknown, Number, Word, YesNo, Any };
+
+Static join(Static a, Static b) {
+    if (a == Static::Unknown) return b;
+    if (b == Static::Unknown || a == b) return a;
+    return Static::Any;
+}
+
+bool known(Static t) { return t == Static::Number || t == Static::Word || t == Static::YesNo; }
+
+const char *type_name(Static t) {
+    switch (t) {
+        case Static::Number: return "a number";
+        case Static::Word: return "a word";
+        case Static::YesNo: return "a yesno";
+        default: return "a value";
+    }
+}
+
+Static literal_type(const Value &v) {
+    switch (v.type) {
+        case Value::Type::Number: return Static::Number;
+        case Value::Type::Word: return Static::Word;
+        case Value::Type::YesNo: return Static::YesNo;
+        default: return Static::Any;
+    }
+}
+
+// Whether running block always ends in a giveback
+bool always_gives_back(const Block &block) {
+    if (block.empty()) return false;
+    const Stmt &last = *block.back();
+    if (last.kind == Stmt::Kind::Giveback) return true;
+    if (last.kind == Stmt::Kind::When) return always_gives_back(last.body) && always_gives_back(last.else_body);
+    return false;
+}
+
+struct Inference {
+    std::map<std::string, Static> names;    // every binding of the name
+    std::map<std::string, Static> params;   // define'd function -> its argument
+    std::map<std::string, Static> returns;  // define'd function -> what it gives back
+    std::set<std::string> functions;        // names bound only by define
+    bool changed = false;
+    bool restores = false;                  // a restore can bind any name
+
+    void bind(std::map<std::string, Static> &m, const std::string &name, Static t) {
+        Static &slot = m[name];
+        Static joined = join(slot, t);
+        if (joined != slot) {
+            slot = joined;
+            changed = true;
+        }
+    }
+
+    Static name_type(const std::string &name) const {
+        auto it = names.find(name);
+        return it == names.end() ? Static::Unknown : it->second;
+    }
+
+    Static type_of(const Expr &e) {
+        switch (e.kind) {
+            case Expr::Kind::Literal:
+                return literal_type(e.literal);
+            case Expr::Kind::Var:
+                // A function used as a value can be called with anything
+                if (functions.count(e.name)) bind(params, e.name, Static::Any);
+                return name_type(e.name);
+            case Expr::Kind::Binary:
+                return binary_type(type_of(*e.args[0]), e.op, type_of(*e.args[1]));
+            case Expr::Kind::Call: {
+                Static arg = e.args.empty() ? Static::Any : Static::Unknown;
+                for (size_t k = 0; k < e.args.size(); ++k) {
+                    Static t = type_of(*e.args[k]);
+                    if (k == 0) arg = t;
+                }
+                if (!functions.count(e.name)) return Static::Any;
+                bind(params, e.name, arg);
+                auto it = returns.find(e.name);
+                return it == returns.end() ? Static::Unknown : it->second;
+            }
+            default:
+                for (auto &a : e.args) type_of(*a);
+                return Static::Any;
+        }
+    }
+
+    // What eval_binary gives for operands of these types; Any where it can
+    // only be nil
+    static Static binary_type(Static a, Op op, Static b) {
+        if (a == Static::Unknown || b == Static::Unknown) return Static::Unknown;
+        if (a == Static::Number && b == Static::Number) {
+            return is_comparison_op(op) ? Static::YesNo : op == Op::Unknown ? Static::Any : Static::Number;
+        }
+        if (op == Op::Plus && ((a == Static::Word && (b == Static::Word || b == Static::Number)) ||
+                               (a == Static::Number && b == Static::Word))) {
+            return Static::Word;
+        }
+        if ((op == Op::Equals || op == Op::NotEqual) && a == Static::Word && b == Static::Word) return Static::YesNo;
+        return Static::Any;
+    }
+
+    void walk(const Block &block, const std::string &function) {
+        for (auto &sp : block) {
+            const Stmt &s = *sp;
+            for (auto &item : s.items) type_of(*item);
+            switch (s.kind) {
+                case Stmt::Kind::Make: {
+                    Static init = s.expr ? type_of(*s.expr) : Static::Any;
+                    bool scalar = s.type.empty() || s.type == "number" || s.type == "word" || s.type == "yesno";
+                    bind(names, s.name, scalar ? init : Static::Any);
+                    break;
+                }
+                case Stmt::Kind::ForRange:
+                    if (s.expr) type_of(*s.expr);
+                    if (s.expr2) type_of(*s.expr2);
+                    if (s.expr3) type_of(*s.expr3);
+                    bind(names, s.name, Static::Number);
+                    break;
+                case Stmt::Kind::ForEach: {
+                    type_of(*s.expr);
+                    bool range = s.expr->kind == Expr::Kind::Call && s.expr->name == "range" && !functions.count("range");
+                    bind(names, s.name, range ? Static::Number : Static::Any);
+                    break;
+                }
+                case Stmt::Kind::Reduce:
+                    if (s.expr) type_of(*s.expr);
+                    bind(names, s.name, s.type == "collect" ? Static::Any : Static::Number);
+                    break;
+                case Stmt::Kind::Define: {
+                    bind(names, s.name, Static::Any);
+                    auto it = params.find(s.name);
+                    if (!s.type.empty()) bind(names, s.type, it == params.end() ? Static::Unknown : it->second);
+                    if (!always_gives_back(s.body)) bind(returns, s.name, Static::Any);
+                    walk(s.body, s.name);
+                    continue;
+                }
+                case Stmt::Kind::Giveback: {
+                    Static t = type_of(*s.expr);
+                    if (!function.empty()) bind(returns, function, t);
+                    break;
+                }
+                case Stmt::Kind::Load:
+                    if (s.expr) type_of(*s.expr);
+                    bind(names, s.name, Static::Any);
+                    break;
+                case Stmt::Kind::Restore:
+                    type_of(*s.expr);
+                    restores = true;
+                    break;
+                default:
+                    if (s.expr) type_of(*s.expr);
+                    if (s.expr2) type_of(*s.expr2);
+                    if (s.expr3) type_of(*s.expr3);
+                    break;
+            }
+            walk(s.body, function);
+            walk(s.else_body, function);
+        }
+    }
+
+    // Names whose every binding is a define
+    static void find_functions(const Block &block, std::map<std::string, bool> &only_define) {
+        for (auto &s : block) {
+            switch (s->kind) {
+                case Stmt::Kind::Define:
+                    only_define.insert(std::make_pair(s->name, true));
+                    if (!s->type.empty()) only_define[s->type] = false;
+                    break;
+                case Stmt::Kind::Make:
+                case Stmt::Kind::ForEach:
+                case Stmt::Kind::ForRange:
+                case Stmt::Kind::Reduce:
+                case Stmt::Kind::Load:
+                    only_define[s->name] = false;
+                    break;
+                default:
+                    break;
+            }
+            find_functions(s->body, only_define);
+            find_functions(s->else_body, only_define);
+        }
+    }
+
+    void run(const Block &body) {
+        std::map<std::string, bool> only_define;
+        find_functions(body, only_define);
+        for (auto &kv : only_define) {
+            if (kv.second) functions.insert(kv.first);
+        }
+        // Types only ever widen, so this settles within a few passes
+        for (int pass = 0; pass < 32; ++pass) {
+            changed = false;
+            walk(body, "");
+            if (!changed) break;
+        }
+        // Names nothing in the program binds come from the host or an
+        // earlier REPL line
+        for (auto &kv : names) {
+            if (kv.second == Static::Unknown || restores) kv.second = Static::Any;
+        }
+    }
+};
+
+// Final types known: marks unboxed trees and collects warnings
+struct Marker {
+    Inference &inf;
+    Program &prog;
+    std::set<std::string> seen;
+
+    void warn(int line, const std::string &what) {
+        std::string text = "line " + std::to_string(line) + ": " + what;
+        if (seen.insert(text).second) prog.warnings.push_back(text);
+    }
+
+    Static type_of(const Expr &e) {
+        switch (e.kind) {
+            case Expr::Kind::Literal: return literal_type(e.literal);
+            case Expr::Kind::Var: return inf.name_type(e.name);
+            case Expr::Kind::Binary: return Inference::binary_type(type_of(*e.args[0]), e.op, type_of(*e.args[1]));
+            case Expr::Kind::Call: {
+                if (!inf.functions.count(e.name)) return Static::Any;
+                auto it = inf.returns.find(e.name);
+                return it == inf.returns.end() || it->second == Static::Unknown ? Static::Any : it->second;
+            }
+            default: return Static::Any;
+        }
+    }
+
+    // Numbers-only leaves and operators: nothing in the tree can have a
+    // side effect, so it can be evaluated again the ordinary way
+    bool pure_number(const Expr &e) {
+        switch (e.kind) {
+            case Expr::Kind::Literal: return e.literal.type == Value::Type::Number;
+            case Expr::Kind::Var: return inf.name_type(e.name) == Static::Number;
+            case Expr::Kind::Binary:
+                return e.op != Op::Unknown && !is_comparison_op(e.op) && pure_number(*e.args[0]) && pure_number(*e.args[1]);
+            default: return false;
+        }
+    }
+
+    void mark(const ExprPtr &e) {
+        if (!e) return;
+        for (auto &a : e->args) mark(a);
+        if (e->kind == Expr::Kind::Binary) {
+            Static a = type_of(*e->args[0]), b = type_of(*e->args[1]);
+            if (known(a) && known(b) && Inference::binary_type(a, e->op, b) == Static::Any) {
+                warn(e->line, e->name + " on " + type_name(a) + " and " + type_name(b) + " always gives nil");
+            }
+            e->unboxed = e->op != Op::Unknown && pure_number(*e->args[0]) && pure_number(*e->args[1]);
+        } else {
+            e->unboxed = pure_number(*e);
+        }
+    }
+
+    // The largest unboxed trees, for --dump-opt
+    void note_unboxed(const ExprPtr &e) {
+        if (!e) return;
+        if (e->kind == Expr::Kind::Binary && e->unboxed) {
+            prog.opt_report.push_back("line " + std::to_string(e->line) + ": " + expr_to_string(*e) + " runs on plain numbers");
+            return;
+        }
+        for (auto &a : e->args) note_unboxed(a);
+    }
+
+    void mark_field(const ExprPtr &e) {
+        mark(e);
+        note_unboxed(e);
+    }
+
+    void mark_block(const Block &block) {
+        for (auto &sp : block) {
+            Stmt &s = *sp;
+            mark_field(s.expr);
+            mark_field(s.expr2);
+            mark_field(s.expr3);
+            for (auto &item : s.items) mark_field(item);
+            if (s.kind == Stmt::Kind::Make && s.expr && (s.type == "number" || s.type == "word" || s.type == "yesno")) {
+                Static t = type_of(*s.expr);
+                Static want = s.type == "number" ? Static::Number : s.type == "word" ? Static::Word : Static::YesNo;
+                if (known(t) && t != want) warn(s.line, s.name + " is made " + s.type + " but is given " + type_name(t));
+            }
+            if (s.kind == Stmt::Kind::When) {
+                Static t = type_of(*s.expr);
+                if (known(t) && t != Static::YesNo) warn(s.line, "when condition is " + std::string(type_name(t)) + ", so it is never true");
+            }
+            mark_block(s.body);
+            mark_block(s.else_body);
+        }
+    }
+};
+
+} // namespace
+
+void infer_types(Program &prog) {
+    Inference inf;
+    inf.run(prog.body);
+    Marker marker{inf, prog, {}};
+    marker.mark_block(prog.body);
+}
@@ -1,18 +1,19 @@
-// SimpliC Interpreter - Lexer, Parser, and Execution Engine
-#include "simplic.hpp"
+// SimpliC Interpreter - Lexer and Execution Engine
+#include "interpreter.hpp"
 #include "dsa.hpp"
+#include "gc.hpp"
 #include <vector>
 #include <string>
 #include <sstream>
 #include <cctype>
 #include <algorithm>
 #include <cmath>
-
-using Token = std::string;
-
-// Forward declarations
-std::vector<std::vector<std::string>> lex_source(const std::string &source);
-void run_lines(const std::vector<std::vector<std::string>> &lines, Environment &env, size_t &i, Value *return_value = nullptr);
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <chrono>
+#include <atomic>
+#include "parallel.hpp"
 
 // Tokenize SimpliC source code into lines of tokens
 std::vector<std::vector<std::string>> lex_source(const std::string &source) {
@@ -46,6 +47,9 @@ std::vector<std::vector<std::string>> lex_source(const std::string &source) {
                     tokens.push_back(token);
                     token.clear();
                 }
+            } else if (c == '.' && !token.empty() && i+1 < line.size() && isdigit((unsigned char)line[i+1]) &&
+                       token.find_first_not_of("-0123456789") == std::string::npos) {
+                token += c;  // decimal point inside a number literal, not a method call
             } else if (c == '(' || c == ')' || c == '[' || c == ']' || c == ',' || c == ';' || c == '=' || c == '.') {
                 if (!token.empty()) {
                     tokens.push_back(token);
@@ -62,500 +66,1387 @@ std::vector<std::vector<std::string>> lex_source(const std::string &source) {
     return lines;
 }
 
-// Helper to check if string is a number
-static bool is_num(const std::string &s) {
-    if (s.empty()) return false;
-    char *end = nullptr;
-    strtod(s.c_str(), &end);
-    return *end == '\0';
+// Binary operations
+Value eval_binary(const Value &a, Op op, const Value &b) {
+    if (a.type == Value::Type::Number && b.type == Value::Type::Number) {
+        double x = a.as_number(), y = b.as_number();
+        switch (op) {
+            case Op::Plus: return Value::from_number(x + y);
+            case Op::Minus: return Value::from_number(x - y);
+            case Op::Times: return Value::from_number(x * y);
+            case Op::Divide: return Value::from_number(x / y);
+            case Op::Mod: return Value::from_number(std::fmod(x, y));
+            case Op::MoreThan: return Value::from_yesno(x > y);
+            case Op::LessThan: return Value::from_yesno(x < y);
+            case Op::Equals: return Value::from_yesno(x == y);
+            case Op::NotEqual: return Value::from_yesno(x != y);
+            default: break;
+        }
+    }
+    if (a.type == Value::Type::Word && b.type == Value::Type::Word) {
+        switch (op) {
+            case Op::Plus: return Value::from_word(a.as_word().append(b.as_word()));
+            case Op::Equals: return Value::from_yesno(a.as_word() == b.as_word());
+            case Op::NotEqual: return Value::from_yesno(a.as_word() != b.as_word());
+            default: break;
+        }
+    }
+    // A word plus a number joins the number as it would be shown
+    if (op == Op::Plus && a.type == Value::Type::Word && b.type == Value::Type::Number) {
+        std::string s = b.to_string();
+        return Value::from_word(a.as_word().append(s.data(), s.size()));
+    }
+    if (op == Op::Plus && a.type == Value::Type::Number && b.type == Value::Type::Word) {
+        return Value::from_word(Word(a.to_string()).append(b.as_word()));
+    }
+    return Value::make_nil();
 }
 
-// Evaluate a single token
-static Value eval_token(const std::string &t, Environment &env) {
-    if (t.size() >= 2 && t.front() == '"' && t.back() == '"') {
-        return Value::from_word(t.substr(1, t.size()-2));
+static Value eval(const Expr &e, Environment &env);
+static Value handle_method_call(Value &obj, const Expr &call, Environment &env);
+
+// Map key: quoted words and numbers are used as written, a bare name is
+// looked up as a variable and falls back to the name itself
+static std::string eval_key(const Expr &e, Environment &env) {
+    if (e.kind == Expr::Kind::Var && e.name_fallback) {
+        Value v;
+        if (env.get(e.name, v) && v.type != Value::Type::Nil) return v.to_string();
+        return e.name;
     }
-    if (t == "yes") return Value::from_yesno(true);
-    if (t == "no") return Value::from_yesno(false);
-    if (is_num(t)) return Value::from_number(std::stod(t));
-    
-    Value v;
-    if (env.get(t, v)) return v;
-    return Value::make_nil();
+    return eval(e, env).to_string();
 }
 
-// Binary operations
-static Value eval_binary(const Value &a, const std::string &op, const Value &b) {
-    if (a.type == Value::Type::Number && b.type == Value::Type::Number) {
-        double x = a.as_number(), y = b.as_number();
-        if (op == "plus") return Value::from_number(x + y);
-        if (op == "minus") return Value::from_number(x - y);
-        if (op == "times") return Value::from_number(x * y);
-        if (op == "divide") return Value::from_number(x / y);
-        if (op == "mod") return Value::from_number(std::fmod(x, y));
-        if (op == "morethan") return Value::from_yesno(x > y);
-        if (op == "lessthan") return Value::from_yesno(x < y);
-        if (op == "equals") return Value::from_yesno(x == y);
-        if (op == "notequal") return Value::from_yesno(x != y);
-    }
-    if (op == "equals" && a.type == Value::Type::Word && b.type == Value::Type::Word) {
-        return Value::from_yesno(a.as_word() == b.as_word());
+// memstats(): the --mem-stats numbers as a map
+static Value mem_stats_value() {
+    MemSnapshot snap = mem_snapshot();
+    Map out;
+    out["heapBytes"] = Value::from_number((double)snap.heap_bytes);
+    out["peakHeapBytes"] = Value::from_number((double)snap.peak_heap_bytes);
+    out["allocations"] = Value::from_number((double)snap.allocations);
+    out["peakRssBytes"] = Value::from_number((double)snap.peak_rss_bytes);
+    for (size_t k = 0; k < (size_t)MemKind::Count; ++k) {
+        const MemCounter &c = snap.kinds[k];
+        Map kind;
+        kind["live"] = Value::from_number((double)c.live);
+        kind["peak"] = Value::from_number((double)c.peak);
+        kind["bytes"] = Value::from_number((double)c.live_bytes);
+        kind["peakBytes"] = Value::from_number((double)c.peak_bytes);
+        out[mem_kind_name((MemKind)k)] = Value::from_map(kind);
     }
-    return Value::make_nil();
+    // Source lines by bytes allocated, most first
+    Map lines;
+    for (auto &l : snap.lines) {
+        Map line;
+        line["allocations"] = Value::from_number((double)l.allocations);
+        line["bytes"] = Value::from_number((double)l.bytes);
+        lines[std::to_string(l.line)] = Value::from_map(line);
+    }
+    out["lines"] = Value::from_map(lines);
+    return Value::from_map(out);
 }
 
-// Parse and evaluate expression (handles: token | left op right | func(arg) | complex)
-static Value eval_expr(const std::vector<std::string> &tokens, size_t start, size_t end, Environment &env) {
-    if (start >= end) return Value::make_nil();
-    if (end - start == 1) return eval_token(tokens[start], env);
-    
-    // Check for function call at start: fname(...)
-    if (end > start+2 && tokens[start+1] == "(") {
-        std::string fname = tokens[start];
-        // Find matching )
-        size_t j = start+2, depth = 1;
-        while (j < end && depth > 0) {
-            if (tokens[j] == "(") ++depth;
-            if (tokens[j] == ")") --depth;
-            ++j;
+// gcstats(): the running interpreter's cycle collector numbers as a map
+static Value gc_stats_value() {
+    GcStats st;
+    if (current_collector) st = current_collector->stats();
+    Map out;
+    out["collections"] = Value::from_number((double)st.collections);
+    out["freed"] = Value::from_number((double)st.freed);
+    out["live"] = Value::from_number((double)st.live);
+    out["liveBytes"] = Value::from_number((double)st.live_bytes);
+    out["pauseMs"] = Value::from_number(st.pause_ms);
+    out["maxPauseMs"] = Value::from_number(st.max_pause_ms);
+    return Value::from_map(out);
+}
+
+// A tree infer_types marked unboxed, on plain doubles: comparisons give 1
+// or 0. False if a variable does not hold a number after all (the host or an
+// earlier REPL line can set any name); such trees have no side effects, so
+// the caller just evaluates them again the ordinary way.
+static bool eval_unboxed(const Expr &e, Environment &env, double &out) {
+    switch (e.kind) {
+        case Expr::Kind::Literal:
+            out = e.literal.number_value;
+            return true;
+        case Expr::Kind::Var: {
+            const Value *v = env.find(e.name);
+            if (!v || v->type != Value::Type::Number) return false;
+            out = v->number_value;
+            return true;
         }
-        Value arg = eval_expr(tokens, start+2, j-1, env);
-        Value fn;
-        if (env.get(fname, fn) && fn.type == Value::Type::Function) {
-            Value result = fn.func_value({arg});
-            // If there's more after the function call, continue evaluating
-            if (j < end) {
-                // We have: result <op> <rest>
-                if (j+1 < end) {
-                    std::string op = tokens[j];
-                    Value right = eval_expr(tokens, j+1, end, env);
-                    return eval_binary(result, op, right);
-                }
+        case Expr::Kind::Binary: {
+            double x, y;
+            if (!eval_unboxed(*e.args[0], env, x) || !eval_unboxed(*e.args[1], env, y)) return false;
+            switch (e.op) {
+                case Op::Plus: out = x + y; break;
+                case Op::Minus: out = x - y; break;
+                case Op::Times: out = x * y; break;
+                case Op::Divide: out = x / y; break;
+                case Op::Mod: out = std::fmod(x, y); break;
+                case Op::MoreThan: out = x > y; break;
+                case Op::LessThan: out = x < y; break;
+                case Op::Equals: out = x == y; break;
+                case Op::NotEqual: out = x != y; break;
+                default: return false;
             }
-            return result;
+            return true;
         }
+        default:
+            return false;
     }
-    
-    // Simple binary: left op right
-    if (end - start == 3) {
-        Value l = eval_token(tokens[start], env);
-        std::string op = tokens[start+1];
-        Value r = eval_token(tokens[start+2], env);
-        return eval_binary(l, op, r);
-    }
-    
-    // Complex expression: evaluate left-to-right
-    // Find first operator and split
-    for (size_t i = start; i < end; ++i) {
-        if (tokens[i] == "plus" || tokens[i] == "minus" || tokens[i] == "times" || 
-            tokens[i] == "divide" || tokens[i] == "mod") {
-            Value left = eval_expr(tokens, start, i, env);
-            Value right = eval_expr(tokens, i+1, end, env);
-            return eval_binary(left, tokens[i], right);
+}
+
+static Value eval(const Expr &e, Environment &env) {
+    switch (e.kind) {
+        case Expr::Kind::Literal:
+            return e.literal;
+        case Expr::Kind::Var: {
+            Value v;
+            if (env.get(e.name, v)) return v;
+            return Value::make_nil();
+        }
+        case Expr::Kind::Binary: {
+            double x;
+            if (e.unboxed && eval_unboxed(e, env, x)) {
+                return is_comparison_op(e.op) ? Value::from_yesno(x != 0) : Value::from_number(x);
+            }
+            Value left = eval(*e.args[0], env);
+            Value right = eval(*e.args[1], env);
+            return eval_binary(left, e.op, right);
+        }
+        case Expr::Kind::Call: {
+            Value fn;
+            if (env.get(e.name, fn) && fn.type == Value::Type::Function) {
+                std::vector<Value> args;
+                for (auto &a : e.args) args.push_back(eval(*a, env));
+                if (args.empty()) args.push_back(Value::make_nil());
+                return fn.func_value(args);
+            }
+            if (e.name == "memstats" && e.args.empty()) return mem_stats_value();
+            if (e.name == "gcstats" && e.args.empty()) return gc_stats_value();
+            if (e.name == "range") {
+                // range(stop), range(start, stop) or range(start, stop, step); stop excluded
+                std::vector<Number> nums;
+                for (auto &a : e.args) nums.push_back(eval(*a, env).as_number());
+                if (nums.size() == 1) nums.insert(nums.begin(), 0);
+                if (nums.size() == 2) nums.push_back(1);
+                if (nums.size() == 3) return Value::from_sequence(Sequence::range(nums[0], nums[1], nums[2], false));
+            }
+            return Value::make_nil();
+        }
+        case Expr::Kind::Method: {
+            Value obj = eval(*e.args[0], env);
+            return handle_method_call(obj, e, env);
+        }
+        case Expr::Kind::Subscript: {
+            Value mapobj = eval(*e.args[0], env);
+            if (mapobj.type == Value::Type::Map) {
+                const Value *v = mapobj.as_map().find(eval_key(*e.args[1], env));
+                if (v) return *v;
+            }
+            return Value::make_nil();
         }
     }
-    
-    return eval_token(tokens[start], env);
+    return Value::make_nil();
 }
 
-// Handle method calls like nums.sort(), s.top, tree.insert(10), tree.inorder(), g.dfs(1)
-static Value handle_method_call(Value &obj, const std::string &method, const std::vector<std::string> &args, Environment &env) {
-    if (obj.type == Value::Type::List && method == "sort") {
-        std::sort(obj.as_list().begin(), obj.as_list().end(), [](const Value &a, const Value &b) {
-            if (a.type == Value::Type::Number && b.type == Value::Type::Number) return a.as_number() < b.as_number();
-            return false;
-        });
-        return Value::make_nil();
-    }
-    if (obj.type == Value::Type::Stack && method == "top") {
-        return obj.stack_value->top();
-    }
-    if (obj.type == Value::Type::Queue && method == "front") {
-        return obj.queue_value->front();
-    }
-    if (obj.type == Value::Type::LinkedList && method == "insert" && args.size() == 1) {
-        Value arg = eval_token(args[0], env);
-        if (arg.type == Value::Type::Number) obj.linklist_value->insert(arg.as_number());
-        return Value::make_nil();
-    }
-    if (obj.type == Value::Type::Set && method == "add" && args.size() == 1) {
-        Value arg = eval_token(args[0], env);
-        obj.set_value->add(arg);
-        return Value::make_nil();
-    }
-    if (obj.type == Value::Type::BST && method == "insert" && args.size() == 1) {
-        Value arg = eval_token(args[0], env);
-        if (arg.type == Value::Type::Number) obj.bst_value->insert(arg.as_number());
-        return Value::make_nil();
-    }
-    if (obj.type == Value::Type::BST && method == "inorder") {
-        auto vals = obj.bst_value->inorder();
-        List result;
-        for (auto v : vals) result.push_back(Value::from_number(v));
-        return Value::from_list(result);
-    }
-    if (obj.type == Value::Type::Graph && method == "addNode" && args.size() == 1) {
-        Value arg = eval_token(args[0], env);
-        if (arg.type == Value::Type::Number) obj.graph_value->addNode((int)arg.as_number());
-        return Value::make_nil();
-    }
-    if (obj.type == Value::Type::Graph && method == "addEdge" && args.size() == 2) {
-        Value arg1 = eval_token(args[0], env);
-        Value arg2 = eval_token(args[1], env);
-        if (arg1.type == Value::Type::Number && arg2.type == Value::Type::Number) {
-            obj.graph_value->addEdge((int)arg1.as_number(), (int)arg2.as_number());
+// Calls f on every element of a list, numbers, map (its keys) or sequence;
+// f returns false to stop
+static void each_element(const Value &container, const std::function<bool(const Value &)> &f) {
+    if (container.type == Value::Type::List) {
+        for (auto &elem : container.as_list()) {
+            if (!f(elem)) return;
         }
-        return Value::make_nil();
-    }
-    if (obj.type == Value::Type::Graph && method == "dfs" && args.size() == 1) {
-        Value arg = eval_token(args[0], env);
-        if (arg.type == Value::Type::Number) {
-            auto path = obj.graph_value->dfs((int)arg.as_number());
-            List result;
-            for (auto n : path) result.push_back(Value::from_number(n));
-            return Value::from_list(result);
+    } else if (container.type == Value::Type::Numbers) {
+        for (double x : container.numbers_value->data) {
+            if (!f(Value::from_number(x))) return;
         }
+    } else if (container.type == Value::Type::Map) {
+        // Map iteration visits keys in insertion order
+        for (auto &k : container.as_map().keys()) {
+            if (!f(Value::from_word(k))) return;
+        }
+    } else if (container.type == Value::Type::Sequence) {
+        container.seq_value->each(f);
     }
+}
+
+static List to_list(const Value &container) {
+    List out;
+    if (container.type == Value::Type::Sequence && container.seq_value->is_range && container.seq_value->stages.empty()) {
+        out.reserve(container.seq_value->count);
+    }
+    each_element(container, [&out](const Value &v) {
+        out.push_back(v);
+        return true;
+    });
+    return out;
+}
+
+// ---- Native methods ----
+// Each takes the receiver and the call site; arguments are call.args[1..].
+// Methods are looked up through a per-type table indexed by the method id
+// interned at parse time, and each call site caches its last lookup. Every
+// (type, method) pair has a handler of its own; methods that differ only in
+// a detail are one template with that detail as a parameter.
+
+static size_t arg_count(const Expr &call) { return call.args.size() - 1; }
+
+static Value arg(const Expr &call, size_t k, Environment &env) {
+    return eval(*call.args[k+1], env);
+}
+
+template <bool Descending, bool Stable>
+static Value sort_in_place(Value &obj, const Expr &, Environment &) {
+    sort_list(obj.as_list(), Descending, Stable);
     return Value::make_nil();
 }
 
-// Main line interpreter with return support
-void run_lines(const std::vector<std::vector<std::string>> &lines, Environment &env, size_t &i, Value *return_value) {
-    size_t n = lines.size();
-    while (i < n) {
-        if (return_value && return_value->type != Value::Type::Nil) return; // early return
-        
-        auto &toks = lines[i];
-        if (toks.empty()) { ++i; continue; }
-
-        // skip "start program" and "end program"
-        if (toks[0] == "start" || toks[0] == "end") { ++i; continue; }
-
-        // make <type> <name> [= value]
-        if (toks[0] == "make") {
-            if (toks.size() >= 2) {
-                std::string dtype = toks[1];
-                std::string name = (toks.size() >= 3) ? toks[2] : "";
-                
-                // Check for shorthand syntax: make x is 10
-                auto ispos = std::find(toks.begin(), toks.end(), std::string("is"));
-                if (ispos != toks.end() && ispos == toks.begin() + 2) {
-                    // Shorthand: make varname is value
-                    name = toks[1];
-                    size_t start = 3; // After "is"
-                    auto val = eval_expr(toks, start, toks.size(), env);
-                    env.set(name, val);
-                    ++i; continue;
-                }
-                
-                if (dtype == "number" || dtype == "word" || dtype == "yesno") {
-                    auto eqpos = std::find(toks.begin(), toks.end(), std::string("="));
-                    if (eqpos != toks.end()) {
-                        size_t start = (eqpos - toks.begin()) + 1;
-                        auto val = eval_expr(toks, start, toks.size(), env);
-                        env.set(name, val);
-                    } else {
-                        env.set(name, Value::make_nil());
-                    }
-                } else if (dtype == "list") {
-                    auto itl = std::find(toks.begin(), toks.end(), std::string("["));
-                    auto itr = std::find(toks.begin(), toks.end(), std::string("]"));
-                    List L;
-                    if (itl != toks.end() && itr != toks.end() && itr > itl) {
-                        for (auto it = itl+1; it != itr; ++it) {
-                            if (*it == ",") continue;
-                            L.push_back(eval_token(*it, env));
-                        }
-                    }
-                    env.set(name, Value::from_list(L));
-                } else if (dtype == "stack") {
-                    env.set(name, Value::from_stack(std::make_shared<Stack>()));
-                } else if (dtype == "queue") {
-                    env.set(name, Value::from_queue(std::make_shared<Queue>()));
-                } else if (dtype == "linkedlist") {
-                    env.set(name, Value::from_linklist(std::make_shared<LinkedList>()));
-                } else if (dtype == "map") {
-                    env.set(name, Value::from_map(Map()));
-                } else if (dtype == "set") {
-                    env.set(name, Value::from_set(std::make_shared<SimpliSet>()));
-                } else if (dtype == "bst") {
-                    env.set(name, Value::from_bst(std::make_shared<BST>()));
-                } else if (dtype == "graph") {
-                    env.set(name, Value::from_graph(std::make_shared<Graph>()));
-                }
-            }
-            ++i; continue;
+// Key function runs once per element, then the keys are sorted stably
+template <bool Descending>
+static Value sort_by(Value &obj, const Expr &call, Environment &env) {
+    if (arg_count(call) != 1) return Value::make_nil();
+    Value fn = arg(call, 0, env);
+    if (fn.type != Value::Type::Function) return Value::make_nil();
+    List &items = obj.as_list();
+    List keys;
+    keys.reserve(items.size());
+    for (auto &item : items) keys.push_back(fn.func_value({item}));
+    sort_list_by_keys(items, keys, Descending);
+    return Value::make_nil();
+}
+
+// Lazy: the step is recorded and only runs when the result is consumed
+template <bool Filter>
+static Value lazy_stage(Value &obj, const Expr &call, Environment &env) {
+    if (arg_count(call) != 1) return Value::make_nil();
+    Value fn = arg(call, 0, env);
+    if (fn.type != Value::Type::Function) return Value::make_nil();
+    if (obj.type == Value::Type::Sequence) return Value::from_sequence(obj.seq_value->with_stage(Filter, fn));
+    Sequence over;
+    over.is_range = false;
+    over.source = obj;
+    return Value::from_sequence(over.with_stage(Filter, fn));
+}
+
+static Value map_has(Value &obj, const Expr &call, Environment &env) {
+    if (arg_count(call) != 1) return Value::make_nil();
+    return Value::from_yesno(obj.as_map().contains(eval_key(*call.args[1], env)));
+}
+
+static Value map_remove(Value &obj, const Expr &call, Environment &env) {
+    if (arg_count(call) != 1) return Value::make_nil();
+    return Value::from_yesno(obj.as_map().erase(eval_key(*call.args[1], env)));
+}
+
+static Value map_keys(Value &obj, const Expr &, Environment &) {
+    List result;
+    obj.as_map().each([&](const std::string &k, const Value &) {
+        result.push_back(Value::from_word(k));
+    });
+    return Value::from_list(result);
+}
+
+static Value map_size(Value &obj, const Expr &, Environment &) {
+    return Value::from_number((double)obj.as_map().size());
+}
+
+static Value seq_to_list(Value &obj, const Expr &, Environment &) {
+    return Value::from_list(to_list(obj));
+}
+
+// sum, or with Count set count
+template <bool Count>
+static Value seq_sum(Value &obj, const Expr &, Environment &) {
+    Number total = 0;
+    obj.seq_value->each([&](const Value &v) {
+        if (Count) total += 1;
+        else if (v.type == Value::Type::Number) total += v.as_number();
+        return true;
+    });
+    return Value::from_number(total);
+}
+
+static Value numbers_size(Value &obj, const Expr &, Environment &) { return Value::from_number((double)obj.numbers_value->size()); }
+static Value numbers_sum(Value &obj, const Expr &, Environment &) { return Value::from_number(obj.numbers_value->sum()); }
+static Value numbers_min(Value &obj, const Expr &, Environment &) { return Value::from_number(obj.numbers_value->min()); }
+static Value numbers_max(Value &obj, const Expr &, Environment &) { return Value::from_number(obj.numbers_value->max()); }
+static Value numbers_mean(Value &obj, const Expr &, Environment &) { return Value::from_number(obj.numbers_value->mean()); }
+
+template <bool Descending>
+static Value numbers_sort(Value &obj, const Expr &, Environment &) {
+    sort_doubles(obj.numbers_value->data, Descending);
+    return Value::make_nil();
+}
+
+static Value numbers_prefix_sum(Value &obj, const Expr &, Environment &) {
+    return Value::from_numbers(make_tracked<NumArray>(obj.numbers_value->prefix_sum()));
+}
+
+// dot, plus and times: elementwise with another numbers value, plus and
+// times also with a single number
+enum class Elementwise { Dot, Plus, Times };
+
+template <Elementwise Op>
+static Value numbers_elementwise(Value &obj, const Expr &call, Environment &env) {
+    if (arg_count(call) != 1) return Value::make_nil();
+    const NumArray &arr = *obj.numbers_value;
+    Value other = arg(call, 0, env);
+    if (other.type == Value::Type::Numbers) {
+        const NumArray &rhs = *other.numbers_value;
+        if (Op == Elementwise::Dot) return Value::from_number(arr.dot(rhs));
+        if (Op == Elementwise::Plus) return Value::from_numbers(make_tracked<NumArray>(arr.plus(rhs)));
+        return Value::from_numbers(make_tracked<NumArray>(arr.times(rhs)));
+    }
+    if (other.type == Value::Type::Number && Op != Elementwise::Dot) {
+        if (Op == Elementwise::Plus) return Value::from_numbers(make_tracked<NumArray>(arr.plus(other.as_number())));
+        return Value::from_numbers(make_tracked<NumArray>(arr.times(other.as_number())));
+    }
+    return Value::make_nil();
+}
+
+static Value stack_top(Value &obj, const Expr &, Environment &) { return obj.stack_value->top(); }
+static Value queue_front(Value &obj, const Expr &, Environment &) { return obj.queue_value->front(); }
+
+// size, isEmpty, peek(k), putAll(items), takeMany(n) and reserve(n) work the
+// same on stacks and queues
+template <bool IsEmpty>
+static Value container_size(Value &obj, const Expr &, Environment &) {
+    size_t n = obj.type == Value::Type::Stack ? obj.stack_value->size() : obj.queue_value->size();
+    if (IsEmpty) return Value::from_yesno(n == 0);
+    return Value::from_number((double)n);
+}
+
+static Value container_peek(Value &obj, const Expr &call, Environment &env) {
+    if (arg_count(call) != 1) return Value::make_nil();
+    Value k = arg(call, 0, env);
+    if (k.type != Value::Type::Number || k.as_number() < 0) return Value::make_nil();
+    size_t at = (size_t)k.as_number();
+    return obj.type == Value::Type::Stack ? obj.stack_value->peek(at) : obj.queue_value->peek(at);
+}
+
+static Value container_put_all(Value &obj, const Expr &call, Environment &env) {
+    if (arg_count(call) != 1) return Value::make_nil();
+    Value items = arg(call, 0, env);
+    if (obj.type == Value::Type::Stack) {
+        if (items.type == Value::Type::List) obj.stack_value->reserve(obj.stack_value->size() + items.as_list().size());
+        each_element(items, [&obj](const Value &v) { obj.stack_value->push(v); return true; });
+    } else {
+        if (items.type == Value::Type::List) obj.queue_value->reserve(obj.queue_value->size() + items.as_list().size());
+        each_element(items, [&obj](const Value &v) { obj.queue_value->push(v); return true; });
+    }
+    return Value::make_nil();
+}
+
+// Removes up to n items and returns them in the order they came out
+static Value container_take_many(Value &obj, const Expr &call, Environment &env) {
+    if (arg_count(call) != 1) return Value::make_nil();
+    Value n = arg(call, 0, env);
+    if (n.type != Value::Type::Number) return Value::make_nil();
+    bool stack = (obj.type == Value::Type::Stack);
+    size_t have = stack ? obj.stack_value->size() : obj.queue_value->size();
+    size_t take = n.as_number() <= 0 ? 0 : std::min(have, (size_t)n.as_number());
+    List out;
+    out.reserve(take);
+    for (size_t k = 0; k < take; ++k) out.push_back(stack ? obj.stack_value->pop() : obj.queue_value->pop());
+    return Value::from_list(out);
+}
+
+static Value container_reserve(Value &obj, const Expr &call, Environment &env) {
+    if (arg_count(call) != 1) return Value::make_nil();
+    Value n = arg(call, 0, env);
+    if (n.type != Value::Type::Number || n.as_number() <= 0) return Value::make_nil();
+    if (obj.type == Value::Type::Stack) obj.stack_value->reserve((size_t)n.as_number());
+    else obj.queue_value->reserve((size_t)n.as_number());
+    return Value::make_nil();
+}
+
+static Value linklist_insert(Value &obj, const Expr &call, Environment &env) {
+    if (arg_count(call) != 1) return Value::make_nil();
+    Value v = arg(call, 0, env);
+    if (v.type == Value::Type::Number) obj.linklist_value->insert(v.as_number());
+    return Value::make_nil();
+}
+
+static Value set_add(Value &obj, const Expr &call, Environment &env) {
+    if (arg_count(call) != 1) return Value::make_nil();
+    obj.set_value->add(arg(call, 0, env));
+    return Value::make_nil();
+}
+
+static Value bst_insert(Value &obj, const Expr &call, Environment &env) {
+    if (arg_count(call) != 1) return Value::make_nil();
+    Value v = arg(call, 0, env);
+    if (v.type == Value::Type::Number) obj.bst_value->insert(v.as_number());
+    return Value::make_nil();
+}
+
+static Value bst_inorder(Value &obj, const Expr &, Environment &) {
+    auto vals = obj.bst_value->inorder();
+    List result;
+    for (auto v : vals) result.push_back(Value::from_number(v));
+    return Value::from_list(result);
+}
+
+static Value graph_add_node(Value &obj, const Expr &call, Environment &env) {
+    if (arg_count(call) != 1) return Value::make_nil();
+    Value v = arg(call, 0, env);
+    if (v.type == Value::Type::Number) obj.graph_value->addNode((int)v.as_number());
+    return Value::make_nil();
+}
+
+static Value graph_add_edge(Value &obj, const Expr &call, Environment &env) {
+    if (arg_count(call) != 2) return Value::make_nil();
+    Value from = arg(call, 0, env);
+    Value to = arg(call, 1, env);
+    if (from.type == Value::Type::Number && to.type == Value::Type::Number) {
+        obj.graph_value->addEdge((int)from.as_number(), (int)to.as_number());
+    }
+    return Value::make_nil();
+}
+
+static Value graph_dfs(Value &obj, const Expr &call, Environment &env) {
+    if (arg_count(call) != 1) return Value::make_nil();
+    Value v = arg(call, 0, env);
+    if (v.type != Value::Type::Number) return Value::make_nil();
+    auto path = obj.graph_value->dfs((int)v.as_number());
+    List result;
+    for (auto n : path) result.push_back(Value::from_number(n));
+    return Value::from_list(result);
+}
+
+static Value heap_push(Value &obj, const Expr &call, Environment &env) {
+    if (arg_count(call) != 1) return Value::make_nil();
+    return Value::from_number(obj.heap_value->push(arg(call, 0, env)));
+}
+
+static Value heap_pop(Value &obj, const Expr &, Environment &) { return obj.heap_value->pop(); }
+static Value heap_peek(Value &obj, const Expr &, Environment &) { return obj.heap_value->peek(); }
+
+template <bool IsEmpty>
+static Value heap_size(Value &obj, const Expr &, Environment &) {
+    if (IsEmpty) return Value::from_yesno(obj.heap_value->empty());
+    return Value::from_number((double)obj.heap_value->size());
+}
+
+static Value heap_heapify(Value &obj, const Expr &call, Environment &env) {
+    if (arg_count(call) != 1) return Value::make_nil();
+    obj.heap_value->heapify(to_list(arg(call, 0, env)));
+    return Value::make_nil();
+}
+
+// decreaseKey(handle, item): swaps in the new item and re-sorts it; the key
+// may move either way
+static Value heap_update(Value &obj, const Expr &call, Environment &env) {
+    if (arg_count(call) != 2) return Value::make_nil();
+    Value handle = arg(call, 0, env);
+    if (handle.type != Value::Type::Number) return Value::from_yesno(false);
+    return Value::from_yesno(obj.heap_value->update(handle.as_number(), arg(call, 1, env)));
+}
+
+// remove(handle): takes that item out, wherever it is in the heap
+static Value heap_remove(Value &obj, const Expr &call, Environment &env) {
+    if (arg_count(call) != 1) return Value::make_nil();
+    Value handle = arg(call, 0, env);
+    if (handle.type != Value::Type::Number) return Value::from_yesno(false);
+    return Value::from_yesno(obj.heap_value->remove(handle.as_number()));
+}
+
+static Value heap_to_list(Value &obj, const Expr &, Environment &) {
+    return Value::from_list(obj.heap_value->items_in_order());
+}
+
+static Value word_size(Value &obj, const Expr &, Environment &) { return Value::from_number((double)obj.as_word().size()); }
+
+// part(start, count): count characters from start (0 for the first); shares
+// the word's text instead of copying it
+static Value word_part(Value &obj, const Expr &call, Environment &env) {
+    if (arg_count(call) < 1 || arg_count(call) > 2) return Value::make_nil();
+    Value start = arg(call, 0, env);
+    Value count = arg_count(call) == 2 ? arg(call, 1, env) : Value::from_number((double)obj.as_word().size());
+    if (start.type != Value::Type::Number || count.type != Value::Type::Number) return Value::make_nil();
+    size_t from = start.as_number() <= 0 ? 0 : (size_t)start.as_number();
+    size_t n = count.as_number() <= 0 ? 0 : (size_t)count.as_number();
+    return Value::from_word(obj.as_word().substr(from, n));
+}
+
+// What a method does besides giving its result, for the parallel for each
+// check
+enum MethodFlags {
+    kMutates = 1,  // changes the receiver
+    kFresh = 2     // gives a container nothing else holds yet
+};
+
+// Every native method, by receiver type
+static const struct { Value::Type type; const char *name; NativeMethod fn; int flags; } kMethods[] = {
+    {Value::Type::List, "sort", sort_in_place<false, false>, kMutates},
+    {Value::Type::List, "sortDescending", sort_in_place<true, false>, kMutates},
+    {Value::Type::List, "stableSort", sort_in_place<false, true>, kMutates},
+    {Value::Type::List, "sortBy", sort_by<false>, kMutates},
+    {Value::Type::List, "sortByDescending", sort_by<true>, kMutates},
+    {Value::Type::List, "map", lazy_stage<false>, 0},
+    {Value::Type::List, "filter", lazy_stage<true>, 0},
+    {Value::Type::Word, "size", word_size, 0},
+    {Value::Type::Word, "part", word_part, 0},
+    {Value::Type::Map, "has", map_has, 0},
+    {Value::Type::Map, "remove", map_remove, kMutates},
+    {Value::Type::Map, "keys", map_keys, kFresh},
+    {Value::Type::Map, "size", map_size, 0},
+    {Value::Type::Numbers, "size", numbers_size, 0},
+    {Value::Type::Numbers, "sum", numbers_sum, 0},
+    {Value::Type::Numbers, "min", numbers_min, 0},
+    {Value::Type::Numbers, "max", numbers_max, 0},
+    {Value::Type::Numbers, "mean", numbers_mean, 0},
+    {Value::Type::Numbers, "sort", numbers_sort<false>, kMutates},
+    {Value::Type::Numbers, "sortDescending", numbers_sort<true>, kMutates},
+    {Value::Type::Numbers, "prefixSum", numbers_prefix_sum, kFresh},
+    {Value::Type::Numbers, "dot", numbers_elementwise<Elementwise::Dot>, 0},
+    {Value::Type::Numbers, "plus", numbers_elementwise<Elementwise::Plus>, 0},
+    {Value::Type::Numbers, "times", numbers_elementwise<Elementwise::Times>, 0},
+    {Value::Type::Numbers, "map", lazy_stage<false>, 0},
+    {Value::Type::Numbers, "filter", lazy_stage<true>, 0},
+    {Value::Type::Sequence, "map", lazy_stage<false>, 0},
+    {Value::Type::Sequence, "filter", lazy_stage<true>, 0},
+    {Value::Type::Sequence, "toList", seq_to_list, kFresh},
+    {Value::Type::Sequence, "sum", seq_sum<false>, 0},
+    {Value::Type::Sequence, "count", seq_sum<true>, 0},
+    {Value::Type::Stack, "top", stack_top, 0},
+    {Value::Type::Queue, "front", queue_front, 0},
+    {Value::Type::Stack, "size", container_size<false>, 0},
+    {Value::Type::Stack, "isEmpty", container_size<true>, 0},
+    {Value::Type::Stack, "peek", container_peek, 0},
+    {Value::Type::Stack, "putAll", container_put_all, kMutates},
+    {Value::Type::Stack, "takeMany", container_take_many, kMutates},
+    {Value::Type::Stack, "reserve", container_reserve, 0},
+    {Value::Type::Queue, "size", container_size<false>, 0},
+    {Value::Type::Queue, "isEmpty", container_size<true>, 0},
+    {Value::Type::Queue, "peek", container_peek, 0},
+    {Value::Type::Queue, "putAll", container_put_all, kMutates},
+    {Value::Type::Queue, "takeMany", container_take_many, kMutates},
+    {Value::Type::Queue, "reserve", container_reserve, 0},
+    {Value::Type::LinkedList, "insert", linklist_insert, kMutates},
+    {Value::Type::Set, "add", set_add, kMutates},
+    {Value::Type::BST, "insert", bst_insert, kMutates},
+    {Value::Type::BST, "inorder", bst_inorder, kFresh},
+    {Value::Type::Graph, "addNode", graph_add_node, kMutates},
+    {Value::Type::Graph, "addEdge", graph_add_edge, kMutates},
+    {Value::Type::Graph, "dfs", graph_dfs, kFresh},
+    {Value::Type::Heap, "push", heap_push, kMutates},
+    {Value::Type::Heap, "pop", heap_pop, kMutates},
+    {Value::Type::Heap, "peek", heap_peek, 0},
+    {Value::Type::Heap, "size", heap_size<false>, 0},
+    {Value::Type::Heap, "isEmpty", heap_size<true>, 0},
+    {Value::Type::Heap, "heapify", heap_heapify, kMutates},
+    {Value::Type::Heap, "decreaseKey", heap_update, kMutates},
+    {Value::Type::Heap, "remove", heap_remove, kMutates},
+    {Value::Type::Heap, "toList", heap_to_list, kFresh},
+};
+
+// Heap is the last Value::Type
+const size_t kTypeCount = (size_t)Value::Type::Heap + 1;
+
+// Method ids and the [type][id] dispatch table, built on first use
+struct MethodTable {
+    std::unordered_map<std::string, int> ids;
+    std::vector<MethodEntry> entries;
+    std::vector<const MethodEntry *> slots;  // kTypeCount rows of ids.size() columns
+    std::vector<int> flags;                  // by id: MethodFlags of any type's method of that name
+
+    MethodTable() {
+        const size_t n = sizeof(kMethods) / sizeof(kMethods[0]);
+        for (size_t k = 0; k < n; ++k) {
+            if (!ids.count(kMethods[k].name)) ids[kMethods[k].name] = (int)ids.size();
+        }
+        entries.reserve(n);
+        for (size_t k = 0; k < n; ++k) {
+            MethodEntry e;
+            e.type = kMethods[k].type;
+            e.method = ids[kMethods[k].name];
+            e.fn = kMethods[k].fn;
+            entries.push_back(e);
         }
+        slots.assign(kTypeCount * ids.size(), nullptr);
+        for (auto &e : entries) slots[(size_t)e.type * ids.size() + e.method] = &e;
+        flags.assign(ids.size(), 0);
+        for (size_t k = 0; k < n; ++k) flags[ids[kMethods[k].name]] |= kMethods[k].flags;
+    }
 
-        // show <values...>
-        if (toks[0] == "show") {
-            for (size_t j=1; j<toks.size();) {
-                // Skip semicolons and commas
-                if (toks[j] == ";" || toks[j] == ",") { 
-                    if (toks[j] == ",") std::cout << " "; 
-                    ++j; 
-                    continue; 
-                }
-                
-                // Check for map[key] access
-                if (j+3 < toks.size() && toks[j+1] == "[" && toks[j+3] == "]") {
-                    std::string mapname = toks[j];
-                    std::string key = toks[j+2];
-                    // Remove quotes from key if present
-                    if (key.size() >= 2 && key.front() == '"' && key.back() == '"') {
-                        key = key.substr(1, key.size()-2);
-                    }
-                    Value mapobj;
-                    if (env.get(mapname, mapobj) && mapobj.type == Value::Type::Map) {
-                        auto &m = mapobj.as_map();
-                        if (m.find(key) != m.end()) {
-                            std::cout << m[key].to_string();
-                        } else {
-                            std::cout << "nil";
-                        }
-                    } else {
-                        std::cout << "nil";
-                    }
-                    j += 4;  // Skip past map[key]
-                    if (j < toks.size() && toks[j] != ";") std::cout << " ";
-                    continue;
-                }
-                
-                // Check for obj.method() or obj.property
-                if (j+2 < toks.size() && toks[j+1] == ".") {
-                    std::string objname = toks[j];
-                    std::string method = toks[j+2];
-                    Value obj;
-                    if (env.get(objname, obj)) {
-                        std::vector<std::string> args;
-                        size_t k = j+3;
-                        if (k < toks.size() && toks[k] == "(") {
-                            ++k;
-                            while (k < toks.size() && toks[k] != ")") {
-                                if (toks[k] != ",") args.push_back(toks[k]);
-                                ++k;
-                            }
-                            ++k; // skip )
-                        }
-                        Value result = handle_method_call(obj, method, args, env);
-                        env.set(objname, obj);  // Save modified object back to environment
-                        std::cout << result.to_string();
-                        j = k;
-                    } else {
-                        ++j;
-                    }
-                } else {
-                    Value v = eval_token(toks[j], env);
-                    std::cout << v.to_string();
-                    ++j;
+    const MethodEntry *lookup(Value::Type type, int method) const {
+        if (method < 0) return nullptr;
+        return slots[(size_t)type * ids.size() + method];
+    }
+};
+
+static const MethodTable &method_table() {
+    static const MethodTable table;
+    return table;
+}
+
+int method_id(const std::string &name) {
+    const MethodTable &table = method_table();
+    auto it = table.ids.find(name);
+    return it == table.ids.end() ? -1 : it->second;
+}
+
+// Whether a method of this id has the flag for some receiver type; the
+// parallel check does not know the receiver's type yet
+static bool method_has(int method, int flag) {
+    return method >= 0 && (method_table().flags[method] & flag) != 0;
+}
+
+// Handle method calls like nums.sort(), s.top, tree.insert(10), tree.inorder(), g.dfs(1)
+static Value handle_method_call(Value &obj, const Expr &call, Environment &env) {
+    const MethodEntry *entry = call.cache.entry.load(std::memory_order_relaxed);
+    if (!entry || entry->type != obj.type) {
+        entry = method_table().lookup(obj.type, call.method);
+        if (!entry) return Value::make_nil();
+        call.cache.entry.store(entry, std::memory_order_relaxed);
+    }
+    return entry->fn(obj, call, env);
+}
+
+// Reduction results of one parallel for each chunk
+struct Reductions {
+    struct Slot {
+        std::string kind;  // "sum", "count" or "collect"
+        Number total = 0;
+        List items;
+    };
+    std::map<std::string, Slot> slots;
+
+    void add(const std::string &kind, const std::string &target, const Value &v) {
+        Slot &slot = slots[target];
+        slot.kind = kind;
+        if (kind == "collect") slot.items.push_back(v);
+        else if (v.type == Value::Type::Number) slot.total += v.as_number();
+    }
+};
+
+// Set while a thread runs a parallel for each chunk: reductions go here
+// instead of straight into the variable
+static thread_local Reductions *current_reductions = nullptr;
+
+// Where show writes on this thread; the running Interpreter's sink
+static thread_local std::ostream *current_out = &std::cout;
+
+// Statement budget and deadline of the running Interpreter, shared with the
+// workers of its parallel loops
+struct RunLimits {
+    uint64_t max_steps = 0;  // statements and block entries; 0: no budget
+    double seconds = 0;      // 0: no deadline
+    std::chrono::steady_clock::time_point deadline;
+    std::atomic<uint64_t> steps{0};
+};
+static thread_local RunLimits *current_limits = nullptr;
+
+// Counts one step (a statement, or a pass into a block so that empty loop
+// bodies count too); the clock is only read every 256 steps
+static void charge_step(RunLimits &limits) {
+    uint64_t n = limits.steps.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (limits.max_steps && n > limits.max_steps) {
+        throw RunLimitError("instruction budget of " + std::to_string(limits.max_steps) + " steps used up", RunLimitError::Limit::Steps);
+    }
+    if (limits.seconds > 0 && (n & 255) == 0 && std::chrono::steady_clock::now() > limits.deadline) {
+        std::ostringstream msg;
+        msg << "timed out after " << limits.seconds << " seconds";
+        throw RunLimitError(msg.str(), RunLimitError::Limit::Time);
+    }
+}
+
+// sum/count add into a number variable, collect appends to a list variable
+static void apply_reduction(const std::string &kind, const std::string &target, const Number total, const List &items, Environment &env) {
+    Value cur;
+    bool have = env.get(target, cur);
+    if (kind == "collect") {
+        if (have && cur.type == Value::Type::List) {
+            cur.as_list().insert(cur.as_list().end(), items.begin(), items.end());
+        } else {
+            env.set(target, Value::from_list(items));
+        }
+        return;
+    }
+    Number base = (have && cur.type == Value::Type::Number) ? cur.as_number() : 0;
+    env.set(target, Value::from_number(base + total));
+}
+
+// A function made by define. A named type rather than a lambda, so the
+// parallel for each check can look into the body a call would run.
+struct DefinedFunction {
+    Block body;
+    std::string argname;
+    Environment *defined_in;
+    std::weak_ptr<Environment> defined_ref;  // defined_in, when it is a shared scope
+    bool closures_inside;                    // body defines functions of its own
+    MemTag tag;
+
+    Value operator()(std::vector<Value> args) const;
+};
+
+// Whether e always gives a value nothing else holds yet
+static bool fresh_expr(const ExprPtr &e) {
+    if (!e) return true;
+    switch (e->kind) {
+        case Expr::Kind::Literal:
+        case Expr::Kind::Binary:
+            return true;
+        case Expr::Kind::Method:
+            return method_has(e->method, kFresh);
+        default:
+            return false;
+    }
+}
+
+// Whether a statement binding s.name gives it a value of its own, so
+// changing that value cannot touch a container another iteration sees
+static bool fresh_binding(const Stmt &s) {
+    switch (s.kind) {
+        case Stmt::Kind::Make:
+            if (s.type.empty() || s.type == "number" || s.type == "word" || s.type == "yesno") return fresh_expr(s.expr);
+            // a list made from another list shares it; numbers copies, the
+            // other containers start empty
+            if (s.type == "list") return s.literal_list || fresh_expr(s.expr);
+            return true;
+        case Stmt::Kind::Load:
+        case Stmt::Kind::ForRange:
+            return true;
+        default:
+            return false;  // for each elements can be containers held elsewhere
+    }
+}
+
+// Names a parallel body (or a function it calls) binds for itself: loop
+// variables, makes, defines and their parameters
+struct LocalNames {
+    std::set<std::string> all;
+    std::set<std::string> functions;  // bound by define
+    std::set<std::string> shared;     // may hold a container from outside
+
+    void collect(const Block &block) {
+        for (auto &s : block) {
+            if (s->kind == Stmt::Kind::Make || s->kind == Stmt::Kind::ForEach || s->kind == Stmt::Kind::ForRange ||
+                s->kind == Stmt::Kind::Load) {
+                all.insert(s->name);
+                if (!fresh_binding(*s)) shared.insert(s->name);
+            }
+            if (s->kind == Stmt::Kind::Define) {
+                all.insert(s->name);
+                functions.insert(s->name);
+                // arguments come from the caller
+                if (!s->type.empty()) {
+                    all.insert(s->type);
+                    shared.insert(s->type);
                 }
-                // Only add space if next token is not semicolon or end
-                if (j < toks.size() && toks[j] != ";") std::cout << " ";
             }
-            std::cout << std::endl;
-            ++i; continue;
+            collect(s->body);
+            collect(s->else_body);
+        }
+    }
+
+    // A name that is only ever a function defined in the body
+    bool is_function(const std::string &name) const {
+        return functions.count(name) && !shared.count(name);
+    }
+};
+
+struct ParallelCheck {
+    const std::string &varname;
+    Environment &env;                  // where names the body does not bind are found
+    LocalNames locals;
+    std::string where;                 // "" for the loop body, else " (in f, ...)"
+    std::set<const Stmt *> &checked;     // function bodies already looked into
+
+    ParallelCheck(const std::string &v, Environment &e, std::set<const Stmt *> &done)
+        : varname(v), env(e), checked(done) {}
+
+    static void fail(const std::string &why) {
+        throw std::runtime_error("parallel for each: " + why);
+    }
+
+    // Containers may only be changed through names the body made fresh
+    void check_change(const std::string &name, const std::string &what) {
+        if (!locals.all.count(name)) fail(what + " is shared with other iterations and cannot be changed here" + where);
+        if (locals.shared.count(name)) {
+            fail(what + " may be a container shared with other iterations, so it cannot be changed here" + where +
+                 "; make a new container in the body instead");
         }
+    }
 
-        // put <value> into <container>
-        if (toks[0] == "put" && toks.size() >= 4 && toks[2] == "into") {
-            Value val = eval_token(toks[1], env);
-            std::string cname = toks[3];
-            Value container;
-            if (env.get(cname, container)) {
-                if (container.type == Value::Type::Stack) {
-                    container.stack_value->push(val);
-                    env.set(cname, container);  // Save back to environment
-                } else if (container.type == Value::Type::Queue) {
-                    container.queue_value->push(val);
-                    env.set(cname, container);  // Save back to environment
-                }
+    // A function the body calls or passes on runs on every worker too, so
+    // its body has to pass the same check
+    void check_function(const std::string &name, const Value &fn) {
+        const DefinedFunction *def = fn.func_value.target<DefinedFunction>();
+        if (!def) fail("'" + name + "' comes from the host program and cannot be checked for safe parallel use" + where);
+        // Copies of a function share its statements, so the first one
+        // names the body; recursion stops here too
+        if (def->body.empty() || !checked.insert(def->body[0].get()).second) return;
+        ParallelCheck callee(varname, *def->defined_in, checked);
+        callee.where = " (in " + name + ", which the loop body calls)";
+        callee.locals.collect(def->body);
+        if (!def->argname.empty()) {
+            callee.locals.all.insert(def->argname);
+            callee.locals.shared.insert(def->argname);
+        }
+        callee.block(def->body, true);
+    }
+
+    void name_use(const ExprPtr &e) {
+        if (locals.all.count(e->name)) {
+            if (e->kind == Expr::Kind::Call && !locals.is_function(e->name)) {
+                fail("'" + e->name + "' may hold any function, so calling it cannot be checked for safe parallel use" + where);
             }
-            ++i; continue;
+            return;
         }
+        Value fn;
+        if (env.get(e->name, fn) && fn.type == Value::Type::Function) check_function(e->name, fn);
+    }
+
+    void expr(const ExprPtr &e) {
+        if (!e) return;
+        if (e->kind == Expr::Kind::Call || e->kind == Expr::Kind::Var) name_use(e);
+        if (e->kind == Expr::Kind::Method && method_has(e->method, kMutates)) {
+            const Expr &obj = *e->args[0];
+            if (obj.kind != Expr::Kind::Var) fail("'." + e->name + "' changes a value that may be shared with other iterations" + where);
+            check_change(obj.name, "'" + obj.name + "." + e->name + "' changes a value that");
+        }
+        for (auto &a : e->args) expr(a);
+    }
 
-        // takeout <container>
-        if (toks[0] == "takeout" && toks.size() >= 2) {
-            std::string cname = toks[1];
-            Value container;
-            if (env.get(cname, container)) {
-                if (container.type == Value::Type::Stack) {
-                    container.stack_value->pop();
-                    env.set(cname, container);  // Save back to environment
-                } else if (container.type == Value::Type::Queue) {
-                    container.queue_value->pop();
-                    env.set(cname, container);  // Save back to environment
+    void block(const Block &body, bool in_define) {
+        for (auto &s : body) {
+            if (s->kind == Stmt::Kind::Show) fail("show is not allowed in the body, collect the values and show them after the loop" + where);
+            if (s->kind == Stmt::Kind::Save) fail("save is not allowed in the body, collect the values and save them after the loop" + where);
+            if (s->kind == Stmt::Kind::Snapshot) fail("snapshot is not allowed in the body" + where);
+            if (s->kind == Stmt::Kind::Restore) fail("restore is not allowed in the body, it changes variables shared with other iterations" + where);
+            if (s->kind == Stmt::Kind::Giveback && !in_define) fail("giveback is not allowed in the body");
+            if ((s->kind == Stmt::Kind::Make || s->kind == Stmt::Kind::Load) && !in_define) {
+                Value outer;
+                if (s->name != varname && env.get(s->name, outer)) {
+                    fail("'" + s->name + "' is declared outside the loop, use sum/count/collect ... into " + s->name);
                 }
             }
-            ++i; continue;
+            if (s->kind == Stmt::Kind::Put || s->kind == Stmt::Kind::Takeout || s->kind == Stmt::Kind::SetIndex) {
+                check_change(s->name, "'" + s->name + "'");
+            }
+            expr(s->expr);
+            expr(s->expr2);
+            expr(s->expr3);
+            for (auto &item : s->items) expr(item);
+            block(s->body, in_define || s->kind == Stmt::Kind::Define);
+            block(s->else_body, in_define);
         }
+    }
+};
+
+// Rejects parallel for each bodies that could race or depend on ordering:
+// output, early return, and writes to variables or containers that live
+// outside the loop other than through sum/count/collect. Functions the body
+// calls are checked the same way, and so is everything they call.
+static void check_parallel_body(const Block &body, const std::string &varname, Environment &env) {
+    std::set<const Stmt *> checked;
+    ParallelCheck check(varname, env, checked);
+    check.locals.collect(body);
+    check.locals.all.insert(varname);
+    check.locals.shared.insert(varname);
+    check.block(body, false);
+}
+
+// Whether running block can define a function
+static bool defines_functions(const Block &block) {
+    for (auto &s : block) {
+        if (s->kind == Stmt::Kind::Define) return true;
+        if (defines_functions(s->body) || defines_functions(s->else_body)) return true;
+    }
+    return false;
+}
+
+// Runs body once per element with the elements split into chunks spread over
+// the work-stealing pool. Each chunk gets its own environment and reduction
+// results; chunk boundaries depend only on the element count and results are
+// merged in chunk order, so the outcome matches a serial run.
+static void run_parallel_for(const Block &body, const std::string &varname, const Value &container, Environment &env) {
+    check_parallel_body(body, varname, env);
+
+    // Plain ranges are indexed directly; other sequences are run once up front
+    const Sequence *range = nullptr;
+    Value items = container;
+    if (container.type == Value::Type::Sequence) {
+        if (container.seq_value->is_range && container.seq_value->stages.empty()) range = container.seq_value.get();
+        else items = Value::from_list(to_list(container));
+    }
 
-        // when <condition> ... otherwise ... done
-        if (toks[0] == "when") {
-            Value cond = eval_expr(toks, 1, toks.size(), env);
-            bool take = (cond.type == Value::Type::YesNo && cond.as_yesno());
-            
-            size_t j = i+1;
-            std::vector<std::vector<std::string>> trueblock, elseblock;
-            bool in_else = false;
-            while (j < n) {
-                if (!lines[j].empty() && lines[j][0] == "done") break;
-                if (!lines[j].empty() && lines[j][0] == "otherwise") { in_else = true; ++j; continue; }
-                if (in_else) elseblock.push_back(lines[j]);
-                else trueblock.push_back(lines[j]);
-                ++j;
+    std::vector<std::string> keys;
+    size_t count = 0;
+    if (range) count = range->count;
+    else if (items.type == Value::Type::List) count = items.as_list().size();
+    else if (items.type == Value::Type::Numbers) count = items.numbers_value->size();
+    else if (items.type == Value::Type::Map) { keys = items.map_value->keys(); count = keys.size(); }
+    if (count == 0) return;
+
+    size_t chunk = std::max<size_t>(1, (count + 1023) / 1024);
+    size_t chunks = (count + chunk - 1) / chunk;
+    std::vector<Reductions> results(chunks);
+
+    // Functions defined in the body may be collected and called after the
+    // loop, so then every item gets a scope on the heap of its own, the same
+    // as a call that defines functions
+    bool closures_inside = defines_functions(body);
+    std::shared_ptr<Environment> keep = env.self.lock();
+
+    std::ostream *out = current_out;
+    RunLimits *limits = current_limits;
+    Collector *gc = current_collector;
+    parallel_for(chunks, [&](size_t c) {
+        Environment chunk_env(&env);
+        Reductions *saved = current_reductions;
+        std::ostream *saved_out = current_out;
+        RunLimits *saved_limits = current_limits;
+        Collector *saved_gc = current_collector;
+        current_reductions = &results[c];
+        current_out = out;
+        current_limits = limits;
+        current_collector = gc;
+        try {
+            for (size_t idx = c * chunk; idx < std::min(count, (c + 1) * chunk); ++idx) {
+                std::shared_ptr<Environment> item_env;
+                if (closures_inside) item_env = Environment::shared(&env, keep);
+                Environment &local = item_env ? *item_env : chunk_env;
+                if (range) local.set(varname, Value::from_number(range->start + (double)idx * range->step));
+                else if (items.type == Value::Type::List) local.set(varname, items.as_list()[idx]);
+                else if (items.type == Value::Type::Numbers) local.set(varname, Value::from_number(items.numbers_value->data[idx]));
+                else local.set(varname, Value::from_word(keys[idx]));
+                run_block(body, local, nullptr);
             }
-            
-            size_t sub_i = 0;
-            if (take) run_lines(trueblock, env, sub_i, return_value);
-            else run_lines(elseblock, env, sub_i, return_value);
-            
-            i = j + 1;
-            continue;
+        } catch (...) {
+            current_reductions = saved;
+            current_out = saved_out;
+            current_limits = saved_limits;
+            current_collector = saved_gc;
+            throw;
         }
+        current_reductions = saved;
+        current_out = saved_out;
+        current_limits = saved_limits;
+        current_collector = saved_gc;
+    });
 
-        // for <var> in <container> ... done  OR  for each <var> in <container> ... done
-        if (toks[0] == "for" && toks.size() >= 4) {
-            std::string varname, cname;
-            
-            // Check for "for each item in list" syntax
-            if (toks.size() >= 5 && toks[1] == "each" && toks[3] == "in") {
-                varname = toks[2];
-                cname = toks[4];
+    for (auto &r : results) {
+        for (auto &kv : r.slots) apply_reduction(kv.second.kind, kv.first, kv.second.total, kv.second.items, env);
+    }
+}
+
+// make <type> <name> [= value], make <name> is <value>
+static void run_make(const Stmt &s, Environment &env) {
+    const std::string &dtype = s.type;
+    double x;
+    if (s.expr && s.expr->unboxed && !(s.expr->kind == Expr::Kind::Binary && is_comparison_op(s.expr->op)) &&
+        (dtype.empty() || dtype == "number") && eval_unboxed(*s.expr, env, x)) {
+        env.set_number(s.name, x);
+    } else if (dtype.empty()) {
+        env.set(s.name, eval(*s.expr, env));
+    } else if (dtype == "number" || dtype == "word" || dtype == "yesno") {
+        env.set(s.name, s.expr ? eval(*s.expr, env) : Value::make_nil());
+    } else if (dtype == "list") {
+        List L;
+        if (s.literal_list) {
+            if (s.items.empty()) {
+                L = s.literal_values;
+            } else {
+                for (auto &item : s.items) L.push_back(eval(*item, env));
             }
-            // Check for "for item in list" syntax
-            else if (toks.size() >= 4 && toks[2] == "in") {
-                varname = toks[1];
-                cname = toks[3];
+        } else if (s.expr) {
+            // Any other initializer: a list is shared, a sequence is run
+            Value init = eval(*s.expr, env);
+            if (init.type == Value::Type::List) {
+                env.set(s.name, init);
+                return;
+            }
+            L = to_list(init);
+        }
+        env.set(s.name, Value::from_list(L));
+    } else if (dtype == "numbers") {
+        // Typed numeric array: [literals] were parsed straight into
+        // doubles, any other initializer must give numbers or a list
+        auto arr = make_tracked<NumArray>();
+        if (s.literal_list) {
+            if (s.items.empty()) {
+                arr->data = s.literal_numbers;
             } else {
-                ++i; continue;
+                arr->data.reserve(s.items.size());
+                for (auto &item : s.items) arr->data.push_back(eval(*item, env).as_number());
             }
-            
-            Value container;
-            if (env.get(cname, container)) {
-                size_t j = i+1;
-                std::vector<std::vector<std::string>> body;
-                int depth = 1;
-                while (j < n && depth > 0) {
-                    const auto &line = lines[j];
-                    if (!line.empty() && (line[0] == "when" || line[0] == "for" || line[0] == "define")) {
-                        depth++;
-                    } else if (line.size() == 1 && line[0] == "done") {
-                        depth--;
-                        if (depth == 0) break;
-                    }
-                    body.push_back(line);
-                    ++j;
-                }
-                
-                if (container.type == Value::Type::List) {
-                    for (auto &elem : container.as_list()) {
-                        env.set(varname, elem);
-                        size_t sub_i = 0;
-                        run_lines(body, env, sub_i, return_value);
-                        if (return_value && return_value->type != Value::Type::Nil) break;
-                    }
-                }
-                i = j + 1;
+        } else if (s.expr) {
+            Value init = eval(*s.expr, env);
+            if (init.type == Value::Type::Numbers) {
+                arr->data = init.numbers_value->data;
+            } else if (init.type == Value::Type::Sequence && init.seq_value->is_range && init.seq_value->stages.empty()) {
+                const Sequence &r = *init.seq_value;
+                arr->data.resize(r.count);
+                for (size_t k = 0; k < r.count; ++k) arr->data[k] = r.start + (double)k * r.step;
             } else {
-                ++i;
+                each_element(init, [&arr](const Value &v) {
+                    arr->data.push_back(v.as_number());
+                    return true;
+                });
+            }
+        }
+        env.set(s.name, Value::from_numbers(arr));
+    } else if (dtype == "stack") {
+        env.set(s.name, Value::from_stack(make_tracked<Stack>()));
+    } else if (dtype == "queue") {
+        env.set(s.name, Value::from_queue(make_tracked<Queue>()));
+    } else if (dtype == "linkedlist") {
+        env.set(s.name, Value::from_linklist(make_tracked<LinkedList>()));
+    } else if (dtype == "map") {
+        env.set(s.name, Value::from_map(Map()));
+    } else if (dtype == "set") {
+        env.set(s.name, Value::from_set(make_tracked<SimpliSet>()));
+    } else if (dtype == "bst") {
+        env.set(s.name, Value::from_bst(make_tracked<BST>()));
+    } else if (dtype == "graph") {
+        env.set(s.name, Value::from_graph(make_tracked<Graph>()));
+    } else if (dtype == "heap" || dtype == "maxheap") {
+        auto heap = make_tracked<Heap>();
+        heap->max_first = (dtype == "maxheap");
+        if (s.expr) {
+            Value fn = eval(*s.expr, env);
+            if (fn.type == Value::Type::Function) {
+                heap->key_fn = [fn](const Value &item) { return fn.func_value({item}); };
             }
-            continue;
         }
+        env.set(s.name, Value::from_heap(heap));
+    }
+}
+
+// Makes the temporaries the optimizer hoisted out of a loop (its else_body)
+// and drops them again however the loop ends, so they are never left among
+// the user's names
+struct LoopTemps {
+    const Block &temps;
+    Environment &env;
+
+    LoopTemps(const Stmt &loop, Environment &env) : temps(loop.else_body), env(env) {
+        try {
+            for (auto &t : temps) run_make(*t, env);
+        } catch (...) {
+            drop();
+            throw;
+        }
+    }
+    ~LoopTemps() { drop(); }
+
+    void drop() {
+        for (auto &t : temps) env.vars.erase(t->name);
+    }
+};
+
+// show <values...>: ',' adds a space, ';' joins without one
+static void run_show(const Stmt &s, Environment &env) {
+    std::ostream &out = *current_out;
+    size_t item = 0;
+    const std::string &parts = s.show_parts;
+    for (size_t p = 0; p < parts.size(); ++p) {
+        if (parts[p] == ',') { out << " "; continue; }
+        if (parts[p] == ';') continue;
+        out << eval(*s.items[item++], env).to_string();
+        if (p + 1 < parts.size() && parts[p+1] != ';') out << " ";
+    }
+    out << std::endl;
+}
+
+// One call of a define'd function, in its fresh local scope
+static Value call_body(const Block &body, const std::string &argname, Environment &local_env, const std::vector<Value> &args) {
+    if (!argname.empty() && !args.empty()) {
+        local_env.set(argname, args[0]);
+    }
+    Value ret_val = Value::make_nil();
+    int caller_line = mem_line();
+    run_block(body, local_env, &ret_val);
+    mem_set_line(caller_line);
+    return ret_val;
+}
+
+Value DefinedFunction::operator()(std::vector<Value> args) const {
+    if (!closures_inside) {
+        Environment local_env(defined_in);  // Set parent to current env
+        return call_body(body, argname, local_env, args);
+    }
+    // Functions defined by this call may outlive it
+    auto local_env = Environment::shared(defined_in, defined_ref.lock());
+    return call_body(body, argname, *local_env, args);
+}
+
+// Main statement interpreter with return support
+bool run_block(const Block &block, Environment &env, Value *return_value) {
+    bool count_lines = mem_stats_on.load(std::memory_order_relaxed);
+    if (current_limits) charge_step(*current_limits);
+    for (auto &sp : block) {
+        const Stmt &s = *sp;
+        if (count_lines) mem_set_line(s.line);
+        if (current_limits) charge_step(*current_limits);
+        // Statement boundaries are safe points, except inside parallel loops
+        if (current_collector && !current_reductions && current_collector->due()) current_collector->collect();
+        switch (s.kind) {
+            case Stmt::Kind::Make:
+                run_make(s, env);
+                break;
 
-        // define <name> with <arg> ... done
-        if (toks[0] == "define" && toks.size() >= 2) {
-            std::string fname = toks[1];
-            std::string argname = "";
-            // Check for "with <argname>" pattern
-            if (toks.size() >= 4 && toks[2] == "with") {
-                argname = toks[3];
+            case Stmt::Kind::Show:
+                run_show(s, env);
+                break;
+
+            // put <value> into <container>
+            case Stmt::Kind::Put: {
+                Value val = eval(*s.expr, env);
+                Value container;
+                if (env.get(s.name, container)) {
+                    if (container.type == Value::Type::Stack) container.stack_value->push(val);
+                    else if (container.type == Value::Type::Queue) container.queue_value->push(val);
+                }
+                break;
             }
-            
-            size_t j = i+1;
-            std::vector<std::vector<std::string>> body;
-            int depth = 1;  // Track nesting depth
-            while (j < n && depth > 0) {
-                const auto &line = lines[j];
-                // Check if this line opens a new block (when, for, define)
-                if (!line.empty() && (line[0] == "when" || line[0] == "for" || line[0] == "define")) {
-                    depth++;
-                } else if (line.size() == 1 && line[0] == "done") {
-                    depth--;
-                    if (depth == 0) break;  // This is the matching done
+
+            // takeout <container>
+            case Stmt::Kind::Takeout: {
+                Value container;
+                if (env.get(s.name, container)) {
+                    if (container.type == Value::Type::Stack) container.stack_value->pop();
+                    else if (container.type == Value::Type::Queue) container.queue_value->pop();
                 }
-                body.push_back(line);
-                ++j;
+                break;
             }
-            
-            auto func = [body, argname, &env](std::vector<Value> args) -> Value {
-                Environment local_env(&env);  // Set parent to current env
-                if (!argname.empty() && !args.empty()) {
-                    local_env.set(argname, args[0]);
+
+            case Stmt::Kind::When: {
+                double x;
+                bool take;
+                if (s.expr->unboxed && s.expr->kind == Expr::Kind::Binary && is_comparison_op(s.expr->op) &&
+                    eval_unboxed(*s.expr, env, x)) {
+                    take = x != 0;
+                } else {
+                    Value cond = eval(*s.expr, env);
+                    take = (cond.type == Value::Type::YesNo && cond.as_yesno());
                 }
-                
-                Value ret_val = Value::make_nil();
-                size_t sub_i = 0;
-                run_lines(body, local_env, sub_i, &ret_val);
-                return ret_val;
-            };
-            
-            env.set(fname, Value::from_function(func));
-            i = j + 1;
-            continue;
-        }
+                if (run_block(take ? s.body : s.else_body, env, return_value)) return true;
+                break;
+            }
 
-        // giveback <expr>
-        if (toks[0] == "giveback" && return_value) {
-            *return_value = eval_expr(toks, 1, toks.size(), env);
-            return;
-        }
+            case Stmt::Kind::ForEach:
+            case Stmt::Kind::ForRange: {
+                LoopTemps temps(s, env);
+                Value container;
+                if (s.kind == Stmt::Kind::ForEach) {
+                    container = eval(*s.expr, env);
+                } else {
+                    // Counted loop: a lazy range, so no list is ever built
+                    Number a = eval(*s.expr, env).as_number();
+                    Number b = eval(*s.expr2, env).as_number();
+                    Number step = s.expr3 ? eval(*s.expr3, env).as_number() : 1;
+                    container = Value::from_sequence(Sequence::range(a, b, step, true));
+                }
 
-        // Handle method calls: obj.method() or obj.method(args)
-        if (toks.size() >= 3 && toks[1] == ".") {
-            std::string objname = toks[0];
-            std::string method = toks[2];
-            Value obj;
-            if (env.get(objname, obj)) {
-                // Parse args if present: method(arg1, arg2)
-                std::vector<std::string> args;
-                if (toks.size() > 3 && toks[3] == "(") {
-                    for (size_t k = 4; k < toks.size(); ++k) {
-                        if (toks[k] == ")" || toks[k] == ",") continue;
-                        args.push_back(toks[k]);
+                // Nested parallel loops run serially inside their chunk
+                if (s.parallel && !current_reductions) {
+                    run_parallel_for(s.body, s.name, container, env);
+                    break;
+                }
+                if (s.kind == Stmt::Kind::ForRange) {
+                    // The counter is written in place instead of boxed per step
+                    const Sequence &r = *container.seq_value;
+                    for (size_t k = 0; k < r.count; ++k) {
+                        env.set_number(s.name, r.start + (double)k * r.step);
+                        if (run_block(s.body, env, return_value)) return true;
                     }
+                    break;
                 }
-                handle_method_call(obj, method, args, env);
-                env.set(objname, obj);  // Save modified object back to environment
+                bool returned = false;
+                each_element(container, [&](const Value &elem) {
+                    env.set(s.name, elem);
+                    returned = run_block(s.body, env, return_value);
+                    return !returned;
+                });
+                if (returned) return true;
+                break;
+            }
+
+            // repeat <n> times ... done
+            case Stmt::Kind::Repeat: {
+                LoopTemps temps(s, env);
+                // Whole runs only: "repeat 2.5 times" runs twice
+                Number times = std::floor(eval(*s.expr, env).as_number());
+                if (!(times > 0)) break;
+                uint64_t count = times < 18446744073709549568.0 ? (uint64_t)times : UINT64_MAX;
+                for (uint64_t k = 0; k < count; ++k) {
+                    if (run_block(s.body, env, return_value)) return true;
+                }
+                break;
+            }
+
+            // sum <expr> into <name>, count into <name>, collect <expr> into <name>
+            case Stmt::Kind::Reduce: {
+                Value v = s.expr ? eval(*s.expr, env) : Value::from_number(1);
+                if (current_reductions) {
+                    current_reductions->add(s.type, s.name, v);
+                } else {
+                    apply_reduction(s.type, s.name, v.type == Value::Type::Number ? v.as_number() : 0, List(1, v), env);
+                }
+                break;
             }
-            ++i; continue;
-        }
 
-        // Handle map subscript assignment: mp["key"] = value
-        if (toks.size() >= 5 && toks[1] == "[" && toks[3] == "]" && toks[4] == "=") {
-            std::string mapname = toks[0];
-            std::string key = toks[2];
-            if (key.size() >= 2 && key.front() == '"' && key.back() == '"') {
-                key = key.substr(1, key.size()-2);
+            // define <name> with <arg> ... done
+            case Stmt::Kind::Define: {
+                Block body = s.body;
+                std::string argname = s.type;
+                Environment *defined_in = &env;
+                // A shared scope is kept alive by the function value; the
+                // lambda itself only holds it weakly so the collector sees
+                // every reference
+                std::shared_ptr<Environment> shared_in = env.self.lock();
+                std::weak_ptr<Environment> defined_ref = shared_in;
+                bool closures_inside = defines_functions(body);
+                MemTag tag(MemKind::Function, sizeof(body) + sizeof(argname) + sizeof(defined_in));
+                DefinedFunction func{body, argname, defined_in, defined_ref, closures_inside, tag};
+                env.set(s.name, Value::from_function(func, shared_in));
+                break;
             }
-            Value mapobj;
-            if (env.get(mapname, mapobj) && mapobj.type == Value::Type::Map) {
-                Value val = eval_expr(toks, 5, toks.size(), env);
-                mapobj.as_map()[key] = val;
-                env.set(mapname, mapobj);  // Save modified map back
+
+            // giveback <expr>
+            case Stmt::Kind::Giveback:
+                if (return_value) {
+                    *return_value = eval(*s.expr, env);
+                    return true;
+                }
+                break;
+
+            // Map subscript assignment: mp["key"] = value
+            case Stmt::Kind::SetIndex: {
+                Value mapobj;
+                if (env.get(s.name, mapobj) && mapobj.type == Value::Type::Map) {
+                    Value val = eval(*s.expr, env);
+                    mapobj.as_map()[eval_key(*s.expr2, env)] = val;
+                }
+                break;
             }
-            ++i; continue;
+
+            // load <kind> <name> from <file>
+            case Stmt::Kind::Load:
+                env.set(s.name, load_file(s.type, eval(*s.expr, env).to_string()));
+                break;
+
+            // save <value> to <file>
+            case Stmt::Kind::Save:
+                save_value(eval(*s.expr, env), eval(*s.expr2, env).to_string());
+                break;
+
+            // snapshot <file>
+            case Stmt::Kind::Snapshot:
+                save_snapshot(env, eval(*s.expr, env).to_string());
+                break;
+
+            // restore <file>
+            case Stmt::Kind::Restore:
+                restore_snapshot(env, eval(*s.expr, env).to_string());
+                break;
+
+            // obj.method(args), f(args)
+            case Stmt::Kind::Eval:
+                eval(*s.expr, env);
+                break;
         }
+    }
+    return false;
+}
+
+void run_program(const Program &prog, Environment &env, Value *return_value) {
+    run_block(prog.body, env, return_value);
+}
 
-        ++i;
+// Runs lines[i..] as a program; kept for callers that work on lexed lines
+void run_lines(const std::vector<std::vector<std::string>> &lines, Environment &env, size_t &i, Value *return_value) {
+    std::vector<std::vector<std::string>> rest(lines.begin() + std::min(i, lines.size()), lines.end());
+    auto prog = parse_program(rest);
+    optimize_program(*prog);
+    i = lines.size();
+    run_program(*prog, env, return_value);
+}
+
+std::shared_ptr<const Program> Interpreter::compile(const std::string &source) {
+    auto prog = parse_program(lex_source(source));
+    optimize_program(*prog);
+    return prog;
+}
+
+Value Interpreter::run(const Program &prog, const Bindings &inputs) {
+    // On the heap, so functions the run gives back can keep using it (not
+    // make_shared, for the same reason as Environment::shared)
+    std::shared_ptr<Environment> scope(new Environment(&root));
+    scope->self = scope;
+    gc.track(scope);
+    for (auto &kv : inputs) scope->set(kv.first, kv.second);
+    return run_in(prog, *scope);
+}
+
+Interpreter::~Interpreter() {
+    // Break whatever cycles are left. The host may still hold some values;
+    // functions among them cannot run once root is gone, so their scopes go too
+    root.vars.clear();
+    gc.collect(false);
+    gc.release_scopes();
+}
+
+Value Interpreter::run_global(const Program &prog) {
+    return run_in(prog, root);
+}
+
+void Interpreter::snapshot(const std::string &path) const {
+    save_snapshot(root, path);
+}
+
+void Interpreter::restore(const std::string &path) {
+    // The restored containers belong to this interpreter's collector
+    Collector *saved_gc = current_collector;
+    current_collector = &gc;
+    try {
+        restore_snapshot(root, path);
+    } catch (...) {
+        current_collector = saved_gc;
+        throw;
     }
+    current_collector = saved_gc;
+}
+
+Value Interpreter::run_in(const Program &prog, Environment &env) {
+    // memstats() needs the counters running from the start
+    if (prog.uses_memstats) enable_mem_stats();
+    RunLimits limits;
+    limits.max_steps = step_budget;
+    limits.seconds = time_budget;
+    limits.deadline = std::chrono::steady_clock::now() +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(time_budget));
+    bool limited = step_budget || time_budget > 0;
+
+    std::ostream *saved = current_out;
+    RunLimits *saved_limits = current_limits;
+    Collector *saved_gc = current_collector;
+    current_out = sink;
+    current_limits = limited ? &limits : nullptr;
+    current_collector = &gc;
+    Value ret = Value::make_nil();
+    try {
+        run_program(prog, env, &ret);
+    } catch (...) {
+        current_out = saved;
+        current_limits = saved_limits;
+        current_collector = saved_gc;
+        throw;
+    }
+    current_out = saved;
+    current_limits = saved_limits;
+    current_collector = saved_gc;
+    return ret;
 }
 
 // Public entry point
 void run_source(const std::string &source) {
-    Environment root(nullptr);
-    auto lines = lex_source(source);
-    size_t i = 0;
-    Value ret = Value::make_nil();
-    run_lines(lines, root, i, &ret);
+    Interpreter interp;
+    interp.run_global(*Interpreter::compile(source));
     // Do not print anything here; output is handled in main.cpp
 }
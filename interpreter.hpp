@@ -0,0 +1,83 @@
+// SimpliC Language - Embedding API (Interpreter and compiled programs)
+#pragma once
+
+#include "ast.hpp"
+#include "gc.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
+#include <cstdint>
+
+// Variables handed to one run, by name
+using Bindings = std::unordered_map<std::string, Value>;
+
+// Thrown when a run goes past its step budget, its time limit or its heap
+// limit
+struct RunLimitError : std::runtime_error {
+    enum class Limit { Steps, Time, Heap } limit;
+    RunLimitError(const std::string &what, Limit which) : std::runtime_error(what), limit(which) {}
+};
+
+// A global scope plus the stream `show` writes to. Compiled programs never
+// change once built, so one can be shared by any number of interpreters.
+// Separate interpreters may run at the same time on different threads; a
+// single interpreter runs one program at a time.
+class Interpreter {
+public:
+    explicit Interpreter(std::ostream &out = std::cout) : root(nullptr), sink(&out) {}
+    ~Interpreter();
+    Interpreter(const Interpreter &) = delete;
+    Interpreter &operator=(const Interpreter &) = delete;
+
+    // Lexes, parses and optimizes source once; the result can be run again
+    // and again without paying for any of that
+    static std::shared_ptr<const Program> compile(const std::string &source);
+    // Same, but reuses the program stored on disk by an earlier run of the
+    // same source, storing it there on a miss (cache.cpp)
+    static std::shared_ptr<const Program> compile_cached(const std::string &source);
+
+    // Runs prog in a fresh scope holding inputs, on top of the globals, so
+    // nothing it makes outlives the run. Returns the top-level giveback
+    // value, nil if there was none. A program that calls memstats() turns
+    // memory counting on for the whole process (memstats.hpp).
+    Value run(const Program &prog, const Bindings &inputs = Bindings());
+    // Runs prog in the global scope: what it makes stays for later runs
+    Value run_global(const Program &prog);
+
+    // Caps every later run at max_steps steps (statements run plus blocks
+    // entered) and timeout_seconds of wall time, 0 for no cap; going over
+    // throws RunLimitError
+    void set_limits(uint64_t max_steps, double timeout_seconds) {
+        step_budget = max_steps;
+        time_budget = timeout_seconds;
+    }
+
+    // Caps the containers and shared scopes still in use after a garbage
+    // collection at about bytes (0 for no cap); checked at each collection,
+    // going over throws RunLimitError
+    void set_heap_limit(size_t bytes) { gc.set_heap_limit(bytes); }
+    GcStats gc_stats() const { return gc.stats(); }
+    // Frees garbage cycles now instead of waiting for enough new objects
+    void collect_garbage() { gc.collect(false); }
+
+    void set_output(std::ostream &out) { sink = &out; }
+    std::ostream &output() const { return *sink; }
+
+    void set(const std::string &name, const Value &val) { root.set(name, val); }
+    bool get(const std::string &name, Value &out) const { return root.get(name, out); }
+
+    // Writes the globals to a snapshot file, or sets them from one, the
+    // same as running `snapshot "path"` or `restore "path"` at top level
+    // (snapshot.cpp); errors throw runtime_error
+    void snapshot(const std::string &path) const;
+    void restore(const std::string &path);
+
+private:
+    Collector gc;  // before root, so the root scope goes first
+    Environment root;
+    std::ostream *sink;
+    uint64_t step_budget = 0;
+    double time_budget = 0;
+
+    Value run_in(const Program &prog, Environment &env);
+};
@@ -0,0 +1,270 @@
+// io.cpp
+// Bulk loading and saving of data files. Files are read in large chunks;
+// while one chunk is parsed the next is already being read on a background
+// thread. Fields are split on commas, semicolons, spaces and tabs, and
+// numbers go through a parser that skips strtod for ordinary decimals.
+
+#include "simplic.hpp"
+#include "dsa.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+#include <cmath>
+#include <future>
+#include <stdexcept>
+
+namespace {
+
+const size_t kChunkSize = 4 << 20;
+
+struct FileCloser {
+    FILE *f;
+    ~FileCloser() { if (f) std::fclose(f); }
+};
+
+bool is_separator(char c) {
+    return c == ',' || c == ';' || c == ' ' || c == '\t' || c == '\r';
+}
+
+// Exact powers of ten a double can hold
+const double kPow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Parses all of [begin, end) as a number. Up to 19 digits with a small
+// exponent are combined exactly (one rounding, like strtod); anything
+// longer falls back to strtod.
+bool parse_number(const char *begin, const char *end, double &out) {
+    const char *p = begin;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+    uint64_t mantissa = 0;
+    int digits = 0, exp10 = 0;
+    bool any = false;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p, any = true) {
+        if (digits < 19) { mantissa = mantissa * 10 + (uint64_t)(*p - '0'); if (mantissa) ++digits; }
+        else ++exp10;
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && *p >= '0' && *p <= '9'; ++p, any = true) {
+            if (digits < 19) { mantissa = mantissa * 10 + (uint64_t)(*p - '0'); if (mantissa) ++digits; --exp10; }
+        }
+    }
+    if (!any) return false;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool eneg = false;
+        if (p < end && (*p == '-' || *p == '+')) eneg = (*p++ == '-');
+        if (p == end || *p < '0' || *p > '9') return false;
+        int e = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+            if (e < 100000) e = e * 10 + (*p - '0');
+        }
+        exp10 += eneg ? -e : e;
+    }
+    if (p != end) return false;
+
+    if (mantissa <= (1ULL << 53) && exp10 >= -22 && exp10 <= 22 && digits < 19) {
+        double v = (double)mantissa;
+        v = exp10 < 0 ? v / kPow10[-exp10] : v * kPow10[exp10];
+        out = negative ? -v : v;
+        return true;
+    }
+    std::string text(begin, end);
+    out = std::strtod(text.c_str(), nullptr);
+    return true;
+}
+
+// A field as a value: a number if it reads as one, otherwise a word with
+// surrounding quotes removed
+Value field_value(const char *begin, const char *end) {
+    double d;
+    if (parse_number(begin, end, d)) return Value::from_number(d);
+    if (end - begin >= 2 && *begin == '"' && end[-1] == '"') ++begin, --end;
+    return Value::from_word(std::string(begin, end));
+}
+
+// Calls on_line(begin, end) for every line of the file, without the '\n'.
+// The next chunk is read on a background thread while this one is parsed.
+template <typename F>
+void each_line(const std::string &path, F on_line) {
+    FileCloser file{std::fopen(path.c_str(), "rb")};
+    if (!file.f) throw std::runtime_error("could not open file: " + path);
+
+    auto read_chunk = [&file]() {
+        std::vector<char> chunk(kChunkSize);
+        chunk.resize(std::fread(chunk.data(), 1, kChunkSize, file.f));
+        return chunk;
+    };
+
+    std::vector<char> carry;  // unfinished last line of the previous chunk
+    std::future<std::vector<char>> next = std::async(std::launch::async, read_chunk);
+    while (true) {
+        std::vector<char> chunk = next.get();
+        bool last = chunk.empty();
+        if (!last) next = std::async(std::launch::async, read_chunk);
+
+        const char *p = chunk.data(), *end = p + chunk.size();
+        if (!carry.empty() || last) {
+            // Finish the carried line with the start of this chunk
+            const char *nl = last ? end : static_cast<const char *>(std::memchr(p, '\n', end - p));
+            if (!nl && !last) {
+                carry.insert(carry.end(), p, end);
+                continue;
+            }
+            carry.insert(carry.end(), p, nl);
+            if (!carry.empty()) on_line(carry.data(), carry.data() + carry.size());
+            carry.clear();
+            if (last) break;
+            p = nl + 1;
+        }
+        while (p < end) {
+            const char *nl = static_cast<const char *>(std::memchr(p, '\n', end - p));
+            if (!nl) {
+                carry.assign(p, end);
+                break;
+            }
+            on_line(p, nl);
+            p = nl + 1;
+        }
+    }
+}
+
+// Calls on_field(begin, end) for each non-empty field of a line
+template <typename F>
+void each_field(const char *p, const char *end, F on_field) {
+    while (p < end) {
+        while (p < end && is_separator(*p)) ++p;
+        const char *start = p;
+        if (p < end && *p == '"') {
+            const char *close = static_cast<const char *>(std::memchr(p + 1, '"', end - p - 1));
+            p = close ? close + 1 : end;
+        }
+        while (p < end && !is_separator(*p)) ++p;
+        if (p > start) on_field(start, p);
+    }
+}
+
+// Shortest text that reads back as the same number
+std::string number_text(double d) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.15g", d);
+    if (std::strtod(buf, nullptr) != d) std::snprintf(buf, sizeof(buf), "%.17g", d);
+    return buf;
+}
+
+std::string field_text(const Value &v) {
+    if (v.type == Value::Type::Number) return number_text(v.as_number());
+    return v.to_string();
+}
+
+} // namespace
+
+Value load_file(const std::string &kind, const std::string &path) {
+    if (kind == "numbers") {
+        auto arr = make_tracked<NumArray>();
+        each_line(path, [&arr, &path](const char *b, const char *e) {
+            each_field(b, e, [&arr, &path](const char *fb, const char *fe) {
+                double d;
+                if (!parse_number(fb, fe, d)) {
+                    throw std::runtime_error("load numbers: '" + std::string(fb, fe) + "' in " + path + " is not a number");
+                }
+                arr->data.push_back(d);
+            });
+        });
+        return Value::from_numbers(arr);
+    }
+    if (kind == "list") {
+        List items;
+        each_line(path, [&items](const char *b, const char *e) {
+            each_field(b, e, [&items](const char *fb, const char *fe) { items.push_back(field_value(fb, fe)); });
+        });
+        return Value::from_list(items);
+    }
+    if (kind == "lines") {
+        List lines;
+        each_line(path, [&lines](const char *b, const char *e) {
+            if (e > b && e[-1] == '\r') --e;
+            lines.push_back(Value::from_word(std::string(b, e)));
+        });
+        return Value::from_list(lines);
+    }
+    if (kind == "map") {
+        // key,value per line; a key on its own maps to nil
+        Map map;
+        each_line(path, [&map](const char *b, const char *e) {
+            Value key, val;
+            int n = 0;
+            each_field(b, e, [&](const char *fb, const char *fe) {
+                if (n == 0) key = field_value(fb, fe);
+                else if (n == 1) val = field_value(fb, fe);
+                ++n;
+            });
+            if (n > 0) map[key.to_string()] = val;
+        });
+        return Value::from_map(map);
+    }
+    if (kind == "graph") {
+        // One edge "from,to" per line; a single number adds a lone node
+        auto graph = make_tracked<Graph>();
+        each_line(path, [&graph, &path](const char *b, const char *e) {
+            double ends[2];
+            int n = 0;
+            each_field(b, e, [&](const char *fb, const char *fe) {
+                // Whole and in int range, so the cast below is defined;
+                // NaN fails both comparisons
+                if (n < 2 && !(parse_number(fb, fe, ends[n]) && ends[n] >= INT_MIN && ends[n] <= INT_MAX &&
+                               ends[n] == std::floor(ends[n]))) {
+                    throw std::runtime_error("load graph: '" + std::string(fb, fe) + "' in " + path + " is not a node number");
+                }
+                ++n;
+            });
+            if (n == 1) graph->addNode((int)ends[0]);
+            else if (n >= 2) graph->addEdge((int)ends[0], (int)ends[1]);
+        });
+        return Value::from_graph(graph);
+    }
+    throw std::runtime_error("load: unknown kind '" + kind + "', use list, numbers, lines, map or graph");
+}
+
+// Lists and numbers are written one item per line, maps as key,value lines,
+// graphs as from,to edge lines; anything else as its shown text
+void save_value(const Value &v, const std::string &path) {
+    FileCloser file{std::fopen(path.c_str(), "wb")};
+    if (!file.f) throw std::runtime_error("could not write file: " + path);
+    std::string out;
+    auto flush = [&out, &file]() {
+        std::fwrite(out.data(), 1, out.size(), file.f);
+        out.clear();
+    };
+    auto line = [&out, &flush](const std::string &text) {
+        out += text;
+        out += '\n';
+        if (out.size() >= kChunkSize) flush();
+    };
+
+    if (v.type == Value::Type::Numbers) {
+        for (double d : v.numbers_value->data) line(number_text(d));
+    } else if (v.type == Value::Type::List || v.type == Value::Type::Sequence) {
+        List tmp;
+        const List *items = &tmp;
+        if (v.type == Value::Type::List) items = &v.as_list();
+        else v.seq_value->each([&tmp](const Value &x) { tmp.push_back(x); return true; });
+        for (auto &item : *items) line(field_text(item));
+    } else if (v.type == Value::Type::Map) {
+        v.as_map().each([&line](const std::string &k, const Value &val) {
+            line(val.type == Value::Type::Nil ? k : k + "," + field_text(val));
+        });
+    } else if (v.type == Value::Type::Graph) {
+        for (auto &kv : v.graph_value->adj) {
+            if (kv.second.empty()) line(std::to_string(kv.first));
+            for (int to : kv.second) line(std::to_string(kv.first) + "," + std::to_string(to));
+        }
+    } else {
+        line(v.to_string());
+    }
+    flush();
+    if (std::ferror(file.f)) throw std::runtime_error("could not write file: " + path);
+}
@@ -1,68 +1,186 @@
 // SimpliC Interpreter - Main Entry Point
-#include "simplic.hpp"
+#include "interpreter.hpp"
+#include "batch.hpp"
+#include "repl.hpp"
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <cstdlib>
+#include <cctype>
+#include <new>
 
 void run_source(const std::string &source);
 
+// Compiles source, through the on-disk cache when use_cache is set. Type
+// warnings go to stderr, and with dump_opt the optimizer's changes too.
+static std::shared_ptr<const Program> compile(const std::string &source, bool dump_opt, bool use_cache) {
+    auto prog = use_cache ? Interpreter::compile_cached(source) : Interpreter::compile(source);
+    for (auto &warning : prog->warnings) std::cerr << "warning: " << warning << std::endl;
+    if (dump_opt) {
+        for (auto &note : prog->opt_report) std::cerr << "opt: " << note << std::endl;
+    }
+    return prog;
+}
+
+// Byte counts like 512, 64K, 200M or 2G
+static size_t parse_size(const std::string &text) {
+    char *end = nullptr;
+    double n = std::strtod(text.c_str(), &end);
+    switch (end && *end ? std::toupper((unsigned char)*end) : 0) {
+        case 'K': n *= 1024.0; break;
+        case 'M': n *= 1024.0 * 1024.0; break;
+        case 'G': n *= 1024.0 * 1024.0 * 1024.0; break;
+    }
+    return n > 0 ? (size_t)n : 0;
+}
+
+// The --mem-stats report, with the cycle collector's numbers when there is
+// an interpreter
+static void print_mem_stats(const Interpreter *interp) {
+    std::cerr << mem_report(mem_snapshot());
+    if (!interp) return;
+    GcStats gc = interp->gc_stats();
+    std::cerr << "gc: " << gc.collections << " collections, " << gc.freed << " objects freed, "
+              << gc.live << " live (about " << gc.live_bytes << " bytes); pauses "
+              << gc.pause_ms << " ms total, " << gc.max_pause_ms << " ms longest" << std::endl;
+}
+
 int main(int argc, char **argv) {
-    if (argc >= 2) {
-        std::ifstream f(argv[1]);
+    bool dump_opt = false, mem_stats = false, use_cache = true;
+    std::string batch, restore;
+    BatchOptions run_opts;
+    int arg = 1;
+    for (; arg < argc && std::string(argv[arg]).compare(0, 2, "--") == 0; ++arg) {
+        std::string opt = argv[arg];
+        bool takes_value = (opt == "--batch" || opt == "--timeout" || opt == "--max-steps" || opt == "--heap-limit" ||
+                            opt == "--restore");
+        if (takes_value && arg + 1 >= argc) {
+            std::cerr << "Option " << opt << " needs a value" << std::endl;
+            return 1;
+        }
+        if (opt == "--dump-opt") dump_opt = true;
+        else if (opt == "--mem-stats") mem_stats = true;
+        else if (opt == "--no-cache") use_cache = false;
+        else if (opt == "--batch") batch = argv[++arg];
+        else if (opt == "--timeout") run_opts.timeout_seconds = std::atof(argv[++arg]);
+        else if (opt == "--max-steps") run_opts.max_steps = std::strtoull(argv[++arg], nullptr, 10);
+        else if (opt == "--heap-limit") run_opts.heap_limit = parse_size(argv[++arg]);
+        else if (opt == "--restore") restore = argv[++arg];
+        else {
+            std::cerr << "Unknown option: " << opt << std::endl;
+            return 1;
+        }
+    }
+    if (mem_stats) enable_mem_stats();
+
+    run_opts.disk_cache = use_cache;
+    run_opts.mem_stats = mem_stats;
+
+    if (!batch.empty() && !restore.empty()) {
+        std::cerr << "--restore cannot be used with --batch" << std::endl;
+        return 1;
+    }
+
+    if (!batch.empty()) {
+        int status = 0;
+        try {
+            status = run_batch(batch, run_opts, std::cout) ? 1 : 0;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            status = 1;
+        }
+        if (mem_stats) print_mem_stats(nullptr);
+        return status;
+    }
+
+    if (arg < argc) {
+        std::ifstream f(argv[arg]);
         if (!f) {
-            std::cerr << "Could not open file: " << argv[1] << std::endl;
+            std::cerr << "Could not open file: " << argv[arg] << std::endl;
             return 1;
         }
         
         std::ostringstream ss;
         ss << f.rdbuf();
         
-        Environment root(nullptr);
-        auto lines = lex_source(ss.str());
-        size_t i = 0;
+        Interpreter interp;
+        interp.set_limits(run_opts.max_steps, run_opts.timeout_seconds);
+        interp.set_heap_limit(run_opts.heap_limit);
         Value ret = Value::make_nil();
         
-        bool has_giveback = false;
-        for (const auto& line : lines) {
-            if (!line.empty() && line[0] == "giveback") {
-                has_giveback = true;
-                break;
-            }
+        int status = 0;
+        try {
+            if (!restore.empty()) interp.restore(restore);
+            auto prog = compile(ss.str(), dump_opt, use_cache);
+            ret = interp.run_global(*prog);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            status = 1;
         }
+        if (mem_stats) print_mem_stats(&interp);
+        if (status) return status;
         
-        run_lines(lines, root, i, &ret);
-        
-        if (has_giveback && ret.type != Value::Type::Nil) {
+        // Only a top-level giveback sets ret
+        if (ret.type != Value::Type::Nil) {
             std::cout << ret.to_string() << std::endl;
         }
         return 0;
     }
 
-    std::cout << "SimpliC REPL. Type 'exit' or 'quit' to leave." << std::endl;
-    Environment root(nullptr);
+    std::cout << "SimpliC REPL. Type 'exit' or 'quit' to leave, ':time' to time each statement." << std::endl;
+    Interpreter interp;
+    interp.set_limits(run_opts.max_steps, run_opts.timeout_seconds);
+    interp.set_heap_limit(run_opts.heap_limit);
+    if (!restore.empty()) {
+        try {
+            interp.restore(restore);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    Repl repl(interp, std::cerr, dump_opt);
     
     while (true) {
-        std::cout << "> ";
+        // "..." while a define, when, for or repeat is waiting for its done
+        std::cout << (repl.continuing() ? "... " : "> ");
         std::cout.flush();  // Ensure prompt is displayed immediately
         
         std::string line;
         if (!std::getline(std::cin, line)) break;
-        if (line == "exit" || line == "quit") break;
-        if (line.empty()) continue;  // Skip empty lines
+        if (!repl.continuing() && (line == "exit" || line == "quit")) break;
         
         try {
-            auto lines = lex_source(line);
-            size_t i = 0;
-            Value ret = Value::make_nil();
-            
-            run_lines(lines, root, i, &ret);
-            
-            if (ret.type != Value::Type::Nil) {
-                std::cout << ret.to_string() << std::endl;
-            }
+            repl.feed(line);
         } catch (const std::exception& e) {
             std::cerr << "Error: " << e.what() << std::endl;
         }
     }
+    if (mem_stats) print_mem_stats(&interp);
     return 0;
 }
+
+// The executable counts every heap allocation for --mem-stats; a program
+// embedding the library keeps its own operator new
+void *operator new(size_t size) {
+    void *p = mem_malloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return ::operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return mem_malloc(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return mem_malloc(size);
+}
+
+void operator delete(void *p) noexcept { mem_free(p); }
+void operator delete[](void *p) noexcept { mem_free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { mem_free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { mem_free(p); }
@@ -0,0 +1,168 @@
+// memstats.cpp
+// Memory statistics: per-kind object counters, heap totals from mem_malloc
+// (behind the executable's operator new), allocations charged to the
+// running source line, and peak RSS from the OS.
+
+#include "memstats.hpp"
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#include <windows.h>
+#include <psapi.h>
+#define SIMPLIC_USABLE_SIZE(p) _msize(p)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#include <sys/resource.h>
+#define SIMPLIC_USABLE_SIZE(p) malloc_size(p)
+#elif defined(__GLIBC__)
+#include <malloc.h>
+#include <sys/resource.h>
+#define SIMPLIC_USABLE_SIZE(p) malloc_usable_size(p)
+#else
+#include <sys/resource.h>
+#define SIMPLIC_USABLE_SIZE(p) ((size_t)0)
+#endif
+
+std::atomic<bool> mem_stats_on(false);
+
+namespace {
+
+const int kMaxLines = 1 << 16;  // later lines share the last slot
+
+struct AtomicCounter {
+    std::atomic<long long> live{0}, peak{0}, live_bytes{0}, peak_bytes{0};
+};
+
+AtomicCounter kind_counters[(size_t)MemKind::Count];
+std::atomic<long long> heap_bytes(0), peak_heap_bytes(0), allocations(0);
+std::atomic<long long> line_allocations[kMaxLines];
+std::atomic<long long> line_bytes[kMaxLines];
+thread_local int current_line = 0;
+
+void raise_peak(std::atomic<long long> &peak, long long value) {
+    long long cur = peak.load(std::memory_order_relaxed);
+    while (value > cur && !peak.compare_exchange_weak(cur, value, std::memory_order_relaxed)) {}
+}
+
+void count_alloc(void *p) {
+    long long size = (long long)SIMPLIC_USABLE_SIZE(p);
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    raise_peak(peak_heap_bytes, heap_bytes.fetch_add(size, std::memory_order_relaxed) + size);
+    int line = std::min(current_line, kMaxLines - 1);
+    line_allocations[line].fetch_add(1, std::memory_order_relaxed);
+    line_bytes[line].fetch_add(size, std::memory_order_relaxed);
+}
+
+long long peak_rss() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (K32GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return (long long)pmc.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#if defined(__APPLE__)
+    return (long long)usage.ru_maxrss;         // bytes
+#else
+    return (long long)usage.ru_maxrss * 1024;  // kilobytes
+#endif
+#endif
+}
+
+} // namespace
+
+void *mem_malloc(size_t size) {
+    void *p = std::malloc(size ? size : 1);
+    if (p && mem_stats_on.load(std::memory_order_relaxed)) count_alloc(p);
+    return p;
+}
+
+void mem_free(void *p) {
+    if (!p) return;
+    if (mem_stats_on.load(std::memory_order_relaxed)) {
+        heap_bytes.fetch_sub((long long)SIMPLIC_USABLE_SIZE(p), std::memory_order_relaxed);
+    }
+    std::free(p);
+}
+
+const char *mem_kind_name(MemKind kind) {
+    static const char *const names[] = {
+        "list", "map", "stack", "queue", "linkedlist", "set", "bst", "graph", "numbers", "sequence", "heap",
+        "function", "environment", "word"
+    };
+    return names[(size_t)kind];
+}
+
+void enable_mem_stats() {
+    mem_stats_on.store(true);
+}
+
+void mem_set_line(int line) {
+    current_line = line;
+}
+
+int mem_line() {
+    return current_line;
+}
+
+void mem_object_added(MemKind kind, size_t bytes) {
+    AtomicCounter &c = kind_counters[(size_t)kind];
+    raise_peak(c.peak, c.live.fetch_add(1, std::memory_order_relaxed) + 1);
+    raise_peak(c.peak_bytes, c.live_bytes.fetch_add((long long)bytes, std::memory_order_relaxed) + (long long)bytes);
+}
+
+void mem_object_removed(MemKind kind, size_t bytes) {
+    AtomicCounter &c = kind_counters[(size_t)kind];
+    c.live.fetch_sub(1, std::memory_order_relaxed);
+    c.live_bytes.fetch_sub((long long)bytes, std::memory_order_relaxed);
+}
+
+MemSnapshot mem_snapshot() {
+    MemSnapshot snap;
+    for (size_t k = 0; k < (size_t)MemKind::Count; ++k) {
+        snap.kinds[k].live = kind_counters[k].live.load();
+        snap.kinds[k].peak = kind_counters[k].peak.load();
+        snap.kinds[k].live_bytes = kind_counters[k].live_bytes.load();
+        snap.kinds[k].peak_bytes = kind_counters[k].peak_bytes.load();
+    }
+    snap.heap_bytes = heap_bytes.load();
+    snap.peak_heap_bytes = peak_heap_bytes.load();
+    snap.allocations = allocations.load();
+    snap.peak_rss_bytes = peak_rss();
+    // Line 0 is everything outside a statement (parsing, start-up)
+    for (int line = 1; line < kMaxLines; ++line) {
+        long long n = line_allocations[line].load(std::memory_order_relaxed);
+        if (n) snap.lines.push_back(MemLine{line, n, line_bytes[line].load(std::memory_order_relaxed)});
+    }
+    std::sort(snap.lines.begin(), snap.lines.end(), [](const MemLine &a, const MemLine &b) {
+        return a.bytes != b.bytes ? a.bytes > b.bytes : a.line < b.line;
+    });
+    return snap;
+}
+
+std::string mem_report(const MemSnapshot &snap) {
+    std::string out;
+    char buf[160];
+    std::snprintf(buf, sizeof(buf), "heap: %lld bytes live, %lld peak, %lld allocations; peak RSS %lld bytes\n",
+                  snap.heap_bytes, snap.peak_heap_bytes, snap.allocations, snap.peak_rss_bytes);
+    out += buf;
+    std::snprintf(buf, sizeof(buf), "%-12s %10s %10s %12s %12s\n", "kind", "live", "peak", "live bytes", "peak bytes");
+    out += buf;
+    for (size_t k = 0; k < (size_t)MemKind::Count; ++k) {
+        const MemCounter &c = snap.kinds[k];
+        if (!c.peak) continue;
+        std::snprintf(buf, sizeof(buf), "%-12s %10lld %10lld %12lld %12lld\n", mem_kind_name((MemKind)k),
+                      c.live, c.peak, c.live_bytes, c.peak_bytes);
+        out += buf;
+    }
+    if (!snap.lines.empty()) out += "allocations by line (most bytes first):\n";
+    for (size_t k = 0; k < snap.lines.size() && k < 10; ++k) {
+        std::snprintf(buf, sizeof(buf), "  line %-6d %10lld allocations %12lld bytes\n",
+                      snap.lines[k].line, snap.lines[k].allocations, snap.lines[k].bytes);
+        out += buf;
+    }
+    return out;
+}
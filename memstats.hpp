@@ -0,0 +1,119 @@
+// SimpliC Language - Memory Statistics (--mem-stats, memstats())
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+struct Value;
+struct Stack;
+struct Queue;
+struct LinkedList;
+struct SimpliSet;
+struct BST;
+struct Graph;
+struct NumArray;
+struct Sequence;
+struct Heap;
+template <typename V> struct HashMap;
+
+enum class MemKind {
+    List, Map, Stack, Queue, LinkedList, Set, BST, Graph, Numbers, Sequence, Heap, Function, Environment, Word,
+    Count
+};
+
+const char *mem_kind_name(MemKind kind);
+
+// Off until --mem-stats is given or a program calling memstats() starts to
+// run, then on for the rest of the process; the counters below only move
+// while it is on. They are shared by every Interpreter in the process, so
+// with several running at once each sees the others' allocations too.
+extern std::atomic<bool> mem_stats_on;
+void enable_mem_stats();
+
+struct MemCounter {
+    long long live = 0, peak = 0;              // objects
+    long long live_bytes = 0, peak_bytes = 0;  // their own allocations
+};
+
+struct MemLine {
+    int line;
+    long long allocations, bytes;
+};
+
+struct MemSnapshot {
+    MemCounter kinds[(size_t)MemKind::Count];
+    long long heap_bytes = 0, peak_heap_bytes = 0, allocations = 0;
+    long long peak_rss_bytes = 0;
+    std::vector<MemLine> lines;  // source lines that allocated, most bytes first
+};
+
+// malloc/free that keep the heap totals while statistics are on. The
+// simplic executable routes operator new/delete through these; a program
+// embedding the library keeps its own allocator and just sees zero totals.
+void *mem_malloc(size_t size);
+void mem_free(void *p);
+
+void mem_object_added(MemKind kind, size_t bytes);
+void mem_object_removed(MemKind kind, size_t bytes);
+MemSnapshot mem_snapshot();
+std::string mem_report(const MemSnapshot &snap);
+
+// Source line whose statement is running on this thread; heap allocations
+// are charged to it
+void mem_set_line(int line);
+int mem_line();
+
+template <typename T> struct MemKindOf;
+template <> struct MemKindOf<std::vector<Value>> { static const MemKind kind = MemKind::List; };
+template <> struct MemKindOf<HashMap<Value>> { static const MemKind kind = MemKind::Map; };
+template <> struct MemKindOf<Stack> { static const MemKind kind = MemKind::Stack; };
+template <> struct MemKindOf<Queue> { static const MemKind kind = MemKind::Queue; };
+template <> struct MemKindOf<LinkedList> { static const MemKind kind = MemKind::LinkedList; };
+template <> struct MemKindOf<SimpliSet> { static const MemKind kind = MemKind::Set; };
+template <> struct MemKindOf<BST> { static const MemKind kind = MemKind::BST; };
+template <> struct MemKindOf<Graph> { static const MemKind kind = MemKind::Graph; };
+template <> struct MemKindOf<NumArray> { static const MemKind kind = MemKind::Numbers; };
+template <> struct MemKindOf<Sequence> { static const MemKind kind = MemKind::Sequence; };
+template <> struct MemKindOf<Heap> { static const MemKind kind = MemKind::Heap; };
+
+// Deletes what make_tracked made, counting it out if it was counted in
+template <typename T>
+struct MemDelete {
+    bool counted;
+    void operator()(T *p) const {
+        if (counted) mem_object_removed(MemKindOf<T>::kind, sizeof(T));
+        delete p;
+    }
+};
+
+// shared_ptr for Value containers; counted while memory statistics are on.
+// Not make_shared: the object has an allocation of its own, so it is freed
+// and counted out when the last reference goes, even while the collector
+// still holds a weak_ptr to it
+template <typename T, typename... Args>
+std::shared_ptr<T> make_tracked(Args &&... args) {
+    bool counted = mem_stats_on.load(std::memory_order_relaxed);
+    T *obj = new T(std::forward<Args>(args)...);
+    if (counted) mem_object_added(MemKindOf<T>::kind, sizeof(T));
+    return std::shared_ptr<T>(obj, MemDelete<T>{counted});
+}
+
+// Counts whatever holds it (a function closure, an environment) as one
+// object of its kind, copies included
+struct MemTag {
+    MemKind kind;
+    size_t bytes;
+    bool counted;
+
+    MemTag(MemKind k, size_t b) : kind(k), bytes(b), counted(mem_stats_on.load(std::memory_order_relaxed)) {
+        if (counted) mem_object_added(kind, bytes);
+    }
+    MemTag(const MemTag &other) : MemTag(other.kind, other.bytes) {}
+    MemTag &operator=(const MemTag &) { return *this; }
+    ~MemTag() {
+        if (counted) mem_object_removed(kind, bytes);
+    }
+};
@@ -0,0 +1,395 @@
+// numeric.cpp
+// Typed numeric arrays: reductions and element-wise kernels.
+// On x86 the AVX2 or SSE2 versions are chosen once at runtime from CPUID;
+// every other target uses the scalar loops.
+
+#include "simplic.hpp"
+#include "dsa.hpp"
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SIMPLIC_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+struct Kernels {
+    double (*sum)(const double *a, size_t n);
+    double (*min)(const double *a, size_t n);
+    double (*max)(const double *a, size_t n);
+    double (*dot)(const double *a, const double *b, size_t n);
+    void (*add_scalar)(const double *a, double k, double *out, size_t n);
+    void (*mul_scalar)(const double *a, double k, double *out, size_t n);
+    void (*add)(const double *a, const double *b, double *out, size_t n);
+    void (*mul)(const double *a, const double *b, double *out, size_t n);
+};
+
+// Scalar fallbacks (four accumulators so the adds can overlap)
+double sum_scalar(const double *a, size_t n) {
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += a[i]; s1 += a[i+1]; s2 += a[i+2]; s3 += a[i+3];
+    }
+    for (; i < n; ++i) s0 += a[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+// min and max give the first NaN in the array if there is one; the SIMD
+// kernels only note that a NaN went by and then leave the answer to these
+double min_from(double m, const double *a, size_t i, size_t n) {
+    if (m != m) return m;
+    for (; i < n; ++i) {
+        if (a[i] < m) m = a[i];
+        else if (a[i] != a[i]) return a[i];
+    }
+    return m;
+}
+
+double max_from(double m, const double *a, size_t i, size_t n) {
+    if (m != m) return m;
+    for (; i < n; ++i) {
+        if (a[i] > m) m = a[i];
+        else if (a[i] != a[i]) return a[i];
+    }
+    return m;
+}
+
+double min_scalar(const double *a, size_t n) { return min_from(a[0], a, 1, n); }
+double max_scalar(const double *a, size_t n) { return max_from(a[0], a, 1, n); }
+
+double dot_scalar(const double *a, const double *b, size_t n) {
+    double s0 = 0, s1 = 0;
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        s0 += a[i] * b[i]; s1 += a[i+1] * b[i+1];
+    }
+    for (; i < n; ++i) s0 += a[i] * b[i];
+    return s0 + s1;
+}
+
+void add_scalar_scalar(const double *a, double k, double *out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = a[i] + k;
+}
+
+void mul_scalar_scalar(const double *a, double k, double *out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = a[i] * k;
+}
+
+void add_scalar_vec(const double *a, const double *b, double *out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = a[i] + b[i];
+}
+
+void mul_scalar_vec(const double *a, const double *b, double *out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = a[i] * b[i];
+}
+
+#ifdef SIMPLIC_X86_KERNELS
+
+// SSE2: two doubles per register
+__attribute__((target("sse2")))
+double sum_sse2(const double *a, size_t n) {
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 = _mm_add_pd(s0, _mm_loadu_pd(a + i));
+        s1 = _mm_add_pd(s1, _mm_loadu_pd(a + i + 2));
+    }
+    double t[2];
+    _mm_storeu_pd(t, _mm_add_pd(s0, s1));
+    double s = t[0] + t[1];
+    for (; i < n; ++i) s += a[i];
+    return s;
+}
+
+__attribute__((target("sse2")))
+double min_sse2(const double *a, size_t n) {
+    if (n < 2) return a[0];
+    __m128d m = _mm_loadu_pd(a);
+    __m128d nan = _mm_cmpunord_pd(m, m);
+    size_t i = 2;
+    for (; i + 2 <= n; i += 2) {
+        __m128d v = _mm_loadu_pd(a + i);
+        m = _mm_min_pd(m, v);
+        nan = _mm_or_pd(nan, _mm_cmpunord_pd(v, v));
+    }
+    if (_mm_movemask_pd(nan)) return min_scalar(a, n);
+    double t[2];
+    _mm_storeu_pd(t, m);
+    return min_from(min_scalar(t, 2), a, i, n);
+}
+
+__attribute__((target("sse2")))
+double max_sse2(const double *a, size_t n) {
+    if (n < 2) return a[0];
+    __m128d m = _mm_loadu_pd(a);
+    __m128d nan = _mm_cmpunord_pd(m, m);
+    size_t i = 2;
+    for (; i + 2 <= n; i += 2) {
+        __m128d v = _mm_loadu_pd(a + i);
+        m = _mm_max_pd(m, v);
+        nan = _mm_or_pd(nan, _mm_cmpunord_pd(v, v));
+    }
+    if (_mm_movemask_pd(nan)) return max_scalar(a, n);
+    double t[2];
+    _mm_storeu_pd(t, m);
+    return max_from(max_scalar(t, 2), a, i, n);
+}
+
+__attribute__((target("sse2")))
+double dot_sse2(const double *a, const double *b, size_t n) {
+    __m128d s = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) s = _mm_add_pd(s, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    double t[2];
+    _mm_storeu_pd(t, s);
+    double r = t[0] + t[1];
+    for (; i < n; ++i) r += a[i] * b[i];
+    return r;
+}
+
+__attribute__((target("sse2")))
+void add_scalar_sse2(const double *a, double k, double *out, size_t n) {
+    __m128d kk = _mm_set1_pd(k);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) _mm_storeu_pd(out + i, _mm_add_pd(_mm_loadu_pd(a + i), kk));
+    for (; i < n; ++i) out[i] = a[i] + k;
+}
+
+__attribute__((target("sse2")))
+void mul_scalar_sse2(const double *a, double k, double *out, size_t n) {
+    __m128d kk = _mm_set1_pd(k);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) _mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(a + i), kk));
+    for (; i < n; ++i) out[i] = a[i] * k;
+}
+
+__attribute__((target("sse2")))
+void add_sse2(const double *a, const double *b, double *out, size_t n) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) _mm_storeu_pd(out + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    for (; i < n; ++i) out[i] = a[i] + b[i];
+}
+
+__attribute__((target("sse2")))
+void mul_sse2(const double *a, const double *b, double *out, size_t n) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) _mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    for (; i < n; ++i) out[i] = a[i] * b[i];
+}
+
+// AVX2: four doubles per register, two accumulators for the reductions
+__attribute__((target("avx2")))
+double hsum_avx(__m256d v) {
+    __m128d lo = _mm256_castpd256_pd128(v);
+    __m128d hi = _mm256_extractf128_pd(v, 1);
+    lo = _mm_add_pd(lo, hi);
+    double t[2];
+    _mm_storeu_pd(t, lo);
+    return t[0] + t[1];
+}
+
+__attribute__((target("avx2")))
+double sum_avx2(const double *a, size_t n) {
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm256_add_pd(s0, _mm256_loadu_pd(a + i));
+        s1 = _mm256_add_pd(s1, _mm256_loadu_pd(a + i + 4));
+    }
+    double s = hsum_avx(_mm256_add_pd(s0, s1));
+    for (; i < n; ++i) s += a[i];
+    return s;
+}
+
+__attribute__((target("avx2")))
+double min_avx2(const double *a, size_t n) {
+    if (n < 4) return min_scalar(a, n);
+    __m256d m = _mm256_loadu_pd(a);
+    __m256d nan = _mm256_cmp_pd(m, m, _CMP_UNORD_Q);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) {
+        __m256d v = _mm256_loadu_pd(a + i);
+        m = _mm256_min_pd(m, v);
+        nan = _mm256_or_pd(nan, _mm256_cmp_pd(v, v, _CMP_UNORD_Q));
+    }
+    if (_mm256_movemask_pd(nan)) return min_scalar(a, n);
+    double t[4];
+    _mm256_storeu_pd(t, m);
+    return min_from(min_scalar(t, 4), a, i, n);
+}
+
+__attribute__((target("avx2")))
+double max_avx2(const double *a, size_t n) {
+    if (n < 4) return max_scalar(a, n);
+    __m256d m = _mm256_loadu_pd(a);
+    __m256d nan = _mm256_cmp_pd(m, m, _CMP_UNORD_Q);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) {
+        __m256d v = _mm256_loadu_pd(a + i);
+        m = _mm256_max_pd(m, v);
+        nan = _mm256_or_pd(nan, _mm256_cmp_pd(v, v, _CMP_UNORD_Q));
+    }
+    if (_mm256_movemask_pd(nan)) return max_scalar(a, n);
+    double t[4];
+    _mm256_storeu_pd(t, m);
+    return max_from(max_scalar(t, 4), a, i, n);
+}
+
+__attribute__((target("avx2")))
+double dot_avx2(const double *a, const double *b, size_t n) {
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+    }
+    double r = hsum_avx(_mm256_add_pd(s0, s1));
+    for (; i < n; ++i) r += a[i] * b[i];
+    return r;
+}
+
+__attribute__((target("avx2")))
+void add_scalar_avx2(const double *a, double k, double *out, size_t n) {
+    __m256d kk = _mm256_set1_pd(k);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(a + i), kk));
+    for (; i < n; ++i) out[i] = a[i] + k;
+}
+
+__attribute__((target("avx2")))
+void mul_scalar_avx2(const double *a, double k, double *out, size_t n) {
+    __m256d kk = _mm256_set1_pd(k);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), kk));
+    for (; i < n; ++i) out[i] = a[i] * k;
+}
+
+__attribute__((target("avx2")))
+void add_avx2(const double *a, const double *b, double *out, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    for (; i < n; ++i) out[i] = a[i] + b[i];
+}
+
+__attribute__((target("avx2")))
+void mul_avx2(const double *a, const double *b, double *out, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    for (; i < n; ++i) out[i] = a[i] * b[i];
+}
+
+#endif // SIMPLIC_X86_KERNELS
+
+Kernels pick_kernels() {
+#ifdef SIMPLIC_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        Kernels k = { sum_avx2, min_avx2, max_avx2, dot_avx2,
+                      add_scalar_avx2, mul_scalar_avx2, add_avx2, mul_avx2 };
+        return k;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        Kernels k = { sum_sse2, min_sse2, max_sse2, dot_sse2,
+                      add_scalar_sse2, mul_scalar_sse2, add_sse2, mul_sse2 };
+        return k;
+    }
+#endif
+    Kernels k = { sum_scalar, min_scalar, max_scalar, dot_scalar,
+                  add_scalar_scalar, mul_scalar_scalar, add_scalar_vec, mul_scalar_vec };
+    return k;
+}
+
+const Kernels &kernels() {
+    static const Kernels k = pick_kernels();
+    return k;
+}
+
+} // namespace
+
+double NumArray::sum() const {
+    return data.empty() ? 0.0 : kernels().sum(data.data(), data.size());
+}
+
+double NumArray::min() const {
+    return data.empty() ? std::numeric_limits<double>::quiet_NaN() : kernels().min(data.data(), data.size());
+}
+
+double NumArray::max() const {
+    return data.empty() ? std::numeric_limits<double>::quiet_NaN() : kernels().max(data.data(), data.size());
+}
+
+double NumArray::mean() const {
+    return data.empty() ? std::numeric_limits<double>::quiet_NaN() : sum() / (double)data.size();
+}
+
+// Element-wise methods need arrays of the same length
+static void check_same_size(const char *method, const NumArray &a, const NumArray &b) {
+    if (a.size() != b.size()) {
+        throw std::runtime_error(std::string(method) + ": the arrays have " + std::to_string(a.size()) + " and " +
+                                 std::to_string(b.size()) + " items, they must be the same length");
+    }
+}
+
+double NumArray::dot(const NumArray &other) const {
+    check_same_size("dot", *this, other);
+    size_t n = data.size();
+    return n == 0 ? 0.0 : kernels().dot(data.data(), other.data.data(), n);
+}
+
+NumArray NumArray::plus(double k) const {
+    NumArray out;
+    out.data.resize(data.size());
+    if (!data.empty()) kernels().add_scalar(data.data(), k, out.data.data(), data.size());
+    return out;
+}
+
+NumArray NumArray::times(double k) const {
+    NumArray out;
+    out.data.resize(data.size());
+    if (!data.empty()) kernels().mul_scalar(data.data(), k, out.data.data(), data.size());
+    return out;
+}
+
+NumArray NumArray::plus(const NumArray &other) const {
+    check_same_size("plus", *this, other);
+    NumArray out;
+    out.data.resize(data.size());
+    if (!out.data.empty()) kernels().add(data.data(), other.data.data(), out.data.data(), out.data.size());
+    return out;
+}
+
+NumArray NumArray::times(const NumArray &other) const {
+    check_same_size("times", *this, other);
+    NumArray out;
+    out.data.resize(data.size());
+    if (!out.data.empty()) kernels().mul(data.data(), other.data.data(), out.data.data(), out.data.size());
+    return out;
+}
+
+// Running total; a serial dependency chain, so it stays scalar
+NumArray NumArray::prefix_sum() const {
+    NumArray out;
+    out.data.resize(data.size());
+    double run = 0.0;
+    for (size_t i = 0; i < data.size(); ++i) {
+        run += data[i];
+        out.data[i] = run;
+    }
+    return out;
+}
+
+std::string NumArray::to_string() const {
+    std::ostringstream ss;
+    ss << "[";
+    for (size_t i = 0; i < data.size(); ++i) {
+        if (i > 0) ss << ", ";
+        ss << data[i];
+    }
+    ss << "]";
+    return ss.str();
+}
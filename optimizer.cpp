@@ -0,0 +1,250 @@
+// optimizer.cpp
+// Rewrites a parsed program before it runs:
+//  - folds arithmetic and comparisons on constants
+//  - drops when branches whose condition is a constant, and statements
+//    after a giveback that can never run
+//  - hoists loop-invariant arithmetic out of for/repeat bodies, with one
+//    temporary per distinct expression, made by the loop before its first
+//    pass and dropped when it ends (the loop's else_body)
+//  - then has infer_types (infer.cpp) mark the arithmetic that only ever
+//    sees numbers
+// Every change is recorded in Program::opt_report for --dump-opt.
+
+#include "ast.hpp"
+#include <map>
+#include <set>
+
+namespace {
+
+struct Optimizer {
+    std::vector<std::string> &report;
+    int temp_count = 0;
+
+    explicit Optimizer(std::vector<std::string> &r) : report(r) {}
+
+    void note(int line, const std::string &what) {
+        report.push_back("line " + std::to_string(line) + ": " + what);
+    }
+
+    // ---- Constant folding ----
+
+    ExprPtr fold(const ExprPtr &e) {
+        if (!e || e->args.empty()) return e;
+        std::vector<ExprPtr> args;
+        bool changed = false;
+        for (auto &a : e->args) {
+            args.push_back(fold(a));
+            if (args.back() != a) changed = true;
+        }
+        if (e->kind == Expr::Kind::Binary && e->op != Op::Unknown &&
+            args[0]->kind == Expr::Kind::Literal && args[1]->kind == Expr::Kind::Literal) {
+            Value folded = eval_binary(args[0]->literal, e->op, args[1]->literal);
+            // Left alone when it can only give nil, so infer_types can warn about it
+            if (folded.type != Value::Type::Nil) {
+                auto lit = std::make_shared<Expr>();
+                lit->kind = Expr::Kind::Literal;
+                lit->line = e->line;
+                lit->literal = folded;
+                if (lit->literal.type == Value::Type::Word) lit->literal.word_value = Text::intern(lit->literal.as_word().str());
+                return lit;
+            }
+        }
+        if (!changed) return e;
+        auto copy = std::make_shared<Expr>(*e);
+        copy->args = args;
+        return copy;
+    }
+
+    void fold_field(ExprPtr &e) {
+        if (!e) return;
+        ExprPtr folded = fold(e);
+        if (folded != e) {
+            note(e->line, "folded " + expr_to_string(*e) + " to " + expr_to_string(*folded));
+            e = folded;
+        }
+    }
+
+    // Folds every expression in the block and removes dead code
+    void simplify_block(Block &block) {
+        Block out;
+        for (size_t k = 0; k < block.size(); ++k) {
+            StmtPtr s = block[k];
+            fold_field(s->expr);
+            fold_field(s->expr2);
+            fold_field(s->expr3);
+            for (auto &item : s->items) fold_field(item);
+            simplify_block(s->body);
+            simplify_block(s->else_body);
+
+            if (s->kind == Stmt::Kind::When && s->expr->kind == Expr::Kind::Literal) {
+                bool take = (s->expr->literal.type == Value::Type::YesNo && s->expr->literal.as_yesno());
+                note(s->line, std::string("removed when, condition is always ") + (take ? "yes" : "no"));
+                Block &kept = take ? s->body : s->else_body;
+                out.insert(out.end(), kept.begin(), kept.end());
+                continue;
+            }
+
+            out.push_back(s);
+            if (s->kind == Stmt::Kind::Giveback && k + 1 < block.size()) {
+                note(block[k+1]->line, "removed " + std::to_string(block.size() - k - 1) +
+                     " unreachable statement(s) after giveback");
+                break;
+            }
+        }
+        block.swap(out);
+    }
+
+    // ---- Loop-invariant hoisting ----
+
+    // Names a block (re)binds in its own environment; define bodies run in
+    // their own environment and are not looked into
+    static void bound_names(const Block &block, std::set<std::string> &names) {
+        for (auto &s : block) {
+            switch (s->kind) {
+                case Stmt::Kind::Make:
+                case Stmt::Kind::Define:
+                case Stmt::Kind::Reduce:
+                case Stmt::Kind::ForEach:
+                case Stmt::Kind::ForRange:
+                case Stmt::Kind::Load:
+                    names.insert(s->name);
+                    break;
+                default:
+                    break;
+            }
+            if (s->kind != Stmt::Kind::Define) {
+                bound_names(s->body, names);
+                bound_names(s->else_body, names);
+            }
+        }
+    }
+
+    // restore can rebind any name, so nothing in a loop that runs one is
+    // invariant
+    static bool has_restore(const Block &block) {
+        for (auto &s : block) {
+            if (s->kind == Stmt::Kind::Restore) return true;
+            if (s->kind != Stmt::Kind::Define && (has_restore(s->body) || has_restore(s->else_body))) return true;
+        }
+        return false;
+    }
+
+    // Only literals, variables not bound in the loop, and operators
+    static bool invariant(const Expr &e, const std::set<std::string> &bound) {
+        switch (e.kind) {
+            case Expr::Kind::Literal: return true;
+            case Expr::Kind::Var: return bound.find(e.name) == bound.end();
+            case Expr::Kind::Binary:
+                return e.op != Op::Unknown && invariant(*e.args[0], bound) && invariant(*e.args[1], bound);
+            default: return false;
+        }
+    }
+
+    struct Hoisted {
+        std::map<std::string, std::string> temps; // expression text -> temporary
+        Block defs;
+    };
+
+    // Replaces the largest invariant subexpressions of e with temporaries
+    ExprPtr hoist_expr(const ExprPtr &e, const std::set<std::string> &bound, Hoisted &h, int loop_line) {
+        if (!e) return e;
+        if (e->kind == Expr::Kind::Binary && invariant(*e, bound)) {
+            std::string text = expr_to_string(*e);
+            auto it = h.temps.find(text);
+            std::string temp;
+            if (it != h.temps.end()) {
+                temp = it->second;
+                note(e->line, "reused hoisted " + text);
+            } else {
+                // Temporaries contain a space, so no source name can clash
+                temp = "(loop invariant " + std::to_string(++temp_count) + ")";
+                h.temps[text] = temp;
+                auto def = std::make_shared<Stmt>();
+                def->kind = Stmt::Kind::Make;
+                def->line = loop_line;
+                def->name = temp;
+                def->expr = e;
+                h.defs.push_back(def);
+                note(e->line, "hoisted " + text + " out of the loop at line " + std::to_string(loop_line));
+            }
+            auto var = std::make_shared<Expr>();
+            var->kind = Expr::Kind::Var;
+            var->name = temp;
+            var->line = e->line;
+            return var;
+        }
+        if (e->args.empty()) return e;
+        std::vector<ExprPtr> args;
+        bool changed = false;
+        for (auto &a : e->args) {
+            args.push_back(hoist_expr(a, bound, h, loop_line));
+            if (args.back() != a) changed = true;
+        }
+        if (!changed) return e;
+        auto copy = std::make_shared<Expr>(*e);
+        copy->args = args;
+        return copy;
+    }
+
+    void hoist_in_body(Block &body, const std::set<std::string> &bound, Hoisted &h, int loop_line) {
+        for (auto &s : body) {
+            if (s->kind == Stmt::Kind::Define) continue;
+            s->expr = hoist_expr(s->expr, bound, h, loop_line);
+            s->expr2 = hoist_expr(s->expr2, bound, h, loop_line);
+            s->expr3 = hoist_expr(s->expr3, bound, h, loop_line);
+            for (auto &item : s->items) item = hoist_expr(item, bound, h, loop_line);
+            hoist_in_body(s->body, bound, h, loop_line);
+            hoist_in_body(s->else_body, bound, h, loop_line);
+        }
+    }
+
+    static bool is_loop(const Stmt &s) {
+        return s.kind == Stmt::Kind::ForEach || s.kind == Stmt::Kind::ForRange || s.kind == Stmt::Kind::Repeat;
+    }
+
+    // Temporaries of loops directly in this body move out whole when they
+    // are invariant here too
+    void lift_temps(Block &body, const std::set<std::string> &bound, Hoisted &h, int loop_line) {
+        for (auto &inner : body) {
+            if (!is_loop(*inner)) continue;
+            Block kept;
+            for (auto &s : inner->else_body) {
+                if (invariant(*s->expr, bound)) {
+                    std::string text = expr_to_string(*s->expr);
+                    h.temps[text] = s->name;
+                    h.defs.push_back(s);
+                    note(s->expr->line, "hoisted " + text + " further out, to the loop at line " + std::to_string(loop_line));
+                    continue;
+                }
+                kept.push_back(s);
+            }
+            inner->else_body.swap(kept);
+        }
+    }
+
+    // Inner loops first, so their temporaries can move further out
+    void hoist_block(Block &block) {
+        for (auto &s : block) {
+            hoist_block(s->body);
+            hoist_block(s->else_body);
+            if (is_loop(*s) && !has_restore(s->body)) {
+                std::set<std::string> bound;
+                if (s->kind != Stmt::Kind::Repeat) bound.insert(s->name);
+                bound_names(s->body, bound);
+                Hoisted h;
+                lift_temps(s->body, bound, h, s->line);
+                hoist_in_body(s->body, bound, h, s->line);
+                s->else_body = h.defs;
+            }
+        }
+    }
+};
+
+} // namespace
+
+void optimize_program(Program &prog) {
+    Optimizer opt(prog.opt_report);
+    opt.simplify_block(prog.body);
+    opt.hoist_block(prog.body);
+    infer_types(prog);
+}
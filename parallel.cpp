@@ -0,0 +1,176 @@
+// parallel.cpp
+// Work-stealing pool behind parallel_for
+
+#include "parallel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Task indices owned by one participant; the owner pops from the front,
+// thieves take from the back
+struct TaskQueue {
+    std::mutex m;
+    std::deque<size_t> items;
+
+    bool pop_front(size_t &out) {
+        std::lock_guard<std::mutex> lock(m);
+        if (items.empty()) return false;
+        out = items.front();
+        items.pop_front();
+        return true;
+    }
+
+    bool steal_back(size_t &out) {
+        std::lock_guard<std::mutex> lock(m);
+        if (items.empty()) return false;
+        out = items.back();
+        items.pop_back();
+        return true;
+    }
+};
+
+struct Job {
+    const std::function<void(size_t)> *task = nullptr;
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::atomic<size_t> next_slot;
+    std::atomic<size_t> remaining;
+    std::atomic<bool> failed;
+    std::exception_ptr error;
+    std::mutex done_m;
+    std::condition_variable done_cv;
+
+    Job() : next_slot(0), remaining(0), failed(false) {}
+
+    // Works through slot's queue, then steals until nothing is left
+    void participate(size_t slot) {
+        size_t idx;
+        for (;;) {
+            bool got = queues[slot]->pop_front(idx);
+            for (size_t k = 1; !got && k < queues.size(); ++k) {
+                got = queues[(slot + k) % queues.size()]->steal_back(idx);
+            }
+            if (!got) return;
+            if (!failed.load()) {
+                try {
+                    (*task)(idx);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(done_m);
+                    if (!failed.exchange(true)) error = std::current_exception();
+                }
+            }
+            if (remaining.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(done_m);
+                done_cv.notify_all();
+            }
+        }
+    }
+};
+
+class WorkPool {
+public:
+    WorkPool() {
+        size_t hw = std::thread::hardware_concurrency();
+        size_t n = hw > 1 ? hw - 1 : 0;
+        for (size_t w = 0; w < n; ++w) threads.push_back(std::thread([this]() { worker_loop(); }));
+    }
+
+    ~WorkPool() {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            stop = true;
+        }
+        cv.notify_all();
+        for (auto &t : threads) t.join();
+    }
+
+    size_t size() const { return threads.size(); }
+
+    // Offers the job to idle workers; each one that picks it up claims a slot
+    void offer(const std::shared_ptr<Job> &job) {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            jobs.push_back(job);
+        }
+        cv.notify_all();
+    }
+
+    // Drops a finished job that some workers never got around to claiming
+    void withdraw(const std::shared_ptr<Job> &job) {
+        std::lock_guard<std::mutex> lock(m);
+        jobs.erase(std::remove(jobs.begin(), jobs.end(), job), jobs.end());
+    }
+
+private:
+    std::vector<std::thread> threads;
+    std::mutex m;
+    std::condition_variable cv;
+    std::deque<std::shared_ptr<Job>> jobs;
+    bool stop = false;
+
+    void worker_loop() {
+        for (;;) {
+            std::shared_ptr<Job> job;
+            size_t slot = 0;
+            {
+                std::unique_lock<std::mutex> lock(m);
+                cv.wait(lock, [this]() { return stop || !jobs.empty(); });
+                if (stop) return;
+                job = jobs.front();
+                slot = job->next_slot.fetch_add(1);
+                if (slot + 1 >= job->queues.size()) jobs.pop_front();
+            }
+            if (slot < job->queues.size()) job->participate(slot);
+        }
+    }
+};
+
+WorkPool &pool() {
+    static WorkPool p;
+    return p;
+}
+
+} // namespace
+
+size_t parallel_threads() {
+    return pool().size() + 1;
+}
+
+void parallel_for(size_t count, const std::function<void(size_t)> &task) {
+    if (count == 0) return;
+    size_t slots = std::min(parallel_threads(), count);
+    if (slots == 1) {
+        for (size_t i = 0; i < count; ++i) task(i);
+        return;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->task = &task;
+    job->remaining = count;
+    for (size_t s = 0; s < slots; ++s) {
+        job->queues.push_back(std::unique_ptr<TaskQueue>(new TaskQueue()));
+        for (size_t i = count * s / slots; i < count * (s + 1) / slots; ++i) {
+            job->queues[s]->items.push_back(i);
+        }
+    }
+
+    // The caller takes slot 0 and the pool fills the rest as workers free up;
+    // if none do, the caller steals everything itself
+    job->next_slot = 1;
+    pool().offer(job);
+    job->participate(0);
+
+    {
+        std::unique_lock<std::mutex> lock(job->done_m);
+        job->done_cv.wait(lock, [&job]() { return job->remaining.load() == 0; });
+    }
+    pool().withdraw(job);
+    if (job->error) std::rethrow_exception(job->error);
+}
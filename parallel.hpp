@@ -0,0 +1,15 @@
+// SimpliC Language - Work-Stealing Thread Pool
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+// Runs task(0) .. task(count-1) on the shared worker pool plus the calling
+// thread and returns once every task has finished. Each participant starts
+// on its own contiguous share of the indices and steals from the back of the
+// others when it runs dry. The first exception thrown by a task is rethrown
+// here after the rest have been drained.
+void parallel_for(size_t count, const std::function<void(size_t)> &task);
+
+// Number of threads that can take part in a parallel_for (pool + caller)
+size_t parallel_threads();
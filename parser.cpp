@@ -0,0 +1,574 @@
+// parser.cpp
+// Turns lexed lines of tokens into a syntax tree. Expressions keep the
+// language's evaluation rules: comparisons bind loosest, and arithmetic
+// splits at its first operator (a minus b plus c is a minus (b plus c)).
+
+#include "ast.hpp"
+#include <cstdlib>
+
+using Tokens = std::vector<std::string>;
+using Lines = std::vector<Tokens>;
+
+Op op_from_word(const std::string &w) {
+    if (w == "plus") return Op::Plus;
+    if (w == "minus") return Op::Minus;
+    if (w == "times") return Op::Times;
+    if (w == "divide") return Op::Divide;
+    if (w == "mod") return Op::Mod;
+    if (w == "morethan") return Op::MoreThan;
+    if (w == "lessthan") return Op::LessThan;
+    if (w == "equals") return Op::Equals;
+    if (w == "notequal") return Op::NotEqual;
+    return Op::Unknown;
+}
+
+bool is_comparison_op(Op op) {
+    return op == Op::MoreThan || op == Op::LessThan || op == Op::Equals || op == Op::NotEqual;
+}
+
+static bool is_arith_word(const std::string &t) {
+    Op op = op_from_word(t);
+    return op != Op::Unknown && !is_comparison_op(op);
+}
+
+static bool is_num(const std::string &s) {
+    if (s.empty()) return false;
+    char *end = nullptr;
+    strtod(s.c_str(), &end);
+    return *end == '\0';
+}
+
+static ExprPtr make_expr(Expr::Kind kind, int line) {
+    auto e = std::make_shared<Expr>();
+    e->kind = kind;
+    e->line = line;
+    return e;
+}
+
+static ExprPtr make_literal(const Value &v, int line) {
+    auto e = make_expr(Expr::Kind::Literal, line);
+    e->literal = v;
+    return e;
+}
+
+static ExprPtr make_binary(ExprPtr l, const std::string &op, ExprPtr r, int line) {
+    auto e = make_expr(Expr::Kind::Binary, line);
+    e->name = op;
+    e->op = op_from_word(op);
+    e->args.push_back(l);
+    e->args.push_back(r);
+    return e;
+}
+
+// A single token: "word", yes, no, a number, or a variable name
+static ExprPtr parse_token(const std::string &t, int line) {
+    if (t.size() >= 2 && t.front() == '"' && t.back() == '"') {
+        return make_literal(Value::from_word(Text::intern(t.substr(1, t.size()-2))), line);
+    }
+    if (t == "yes") return make_literal(Value::from_yesno(true), line);
+    if (t == "no") return make_literal(Value::from_yesno(false), line);
+    if (is_num(t)) return make_literal(Value::from_number(std::strtod(t.c_str(), nullptr)), line);
+    auto e = make_expr(Expr::Kind::Var, line);
+    e->name = t;
+    return e;
+}
+
+// Index of the bracket closing the one at tokens[open], or end
+static size_t matching_close(const Tokens &t, size_t open, size_t end) {
+    int depth = 0;
+    for (size_t k = open; k < end; ++k) {
+        if (t[k] == "(" || t[k] == "[") ++depth;
+        else if (t[k] == ")" || t[k] == "]") {
+            if (--depth == 0) return k;
+        }
+    }
+    return end;
+}
+
+static ExprPtr parse_expr(const Tokens &t, size_t start, size_t end, int line);
+
+// Comma-separated expressions between t[open] and its closing bracket
+static std::vector<ExprPtr> parse_args(const Tokens &t, size_t open, size_t close, int line) {
+    std::vector<ExprPtr> args;
+    size_t arg_start = open + 1;
+    int depth = 0;
+    for (size_t k = open + 1; k < close; ++k) {
+        if (t[k] == "(" || t[k] == "[") ++depth;
+        else if (t[k] == ")" || t[k] == "]") --depth;
+        else if (t[k] == "," && depth == 0) {
+            args.push_back(parse_expr(t, arg_start, k, line));
+            arg_start = k + 1;
+        }
+    }
+    if (close > arg_start) args.push_back(parse_expr(t, arg_start, close, line));
+    return args;
+}
+
+// Parses a call, m[key] or name.method operand at start followed by any
+// .method(args) chain. Returns null if start begins none of these.
+static ExprPtr parse_postfix(const Tokens &t, size_t start, size_t end, size_t &next, int line) {
+    ExprPtr e;
+    size_t k;
+    if (start + 2 < end && t[start+1] == "(") {
+        size_t close = matching_close(t, start+1, end);
+        e = make_expr(Expr::Kind::Call, line);
+        e->name = t[start];
+        e->args = parse_args(t, start+1, close, line);
+        k = close + 1;
+    } else if (start + 3 < end && t[start+1] == "[") {
+        size_t close = matching_close(t, start+1, end);
+        if (close >= end) return nullptr;
+        e = make_expr(Expr::Kind::Subscript, line);
+        e->args.push_back(parse_token(t[start], line));
+        ExprPtr key = parse_expr(t, start+2, close, line);
+        if (key->kind == Expr::Kind::Var) key->name_fallback = true;
+        e->args.push_back(key);
+        k = close + 1;
+    } else if (start + 2 < end && t[start+1] == ".") {
+        e = parse_token(t[start], line);
+        k = start + 1;
+    } else {
+        return nullptr;
+    }
+
+    while (k + 1 < end && t[k] == ".") {
+        auto m = make_expr(Expr::Kind::Method, line);
+        m->name = t[k+1];
+        m->method = method_id(m->name);
+        m->args.push_back(e);
+        k += 2;
+        if (k < end && t[k] == "(") {
+            m->parens = true;
+            size_t close = matching_close(t, k, end);
+            for (auto &arg : parse_args(t, k, close, line)) {
+                // A bare name may be a map key (m.has(apple))
+                if (arg->kind == Expr::Kind::Var) arg->name_fallback = true;
+                m->args.push_back(arg);
+            }
+            k = close + 1;
+        }
+        e = m;
+    }
+    next = k;
+    return e;
+}
+
+static ExprPtr parse_expr(const Tokens &t, size_t start, size_t end, int line) {
+    if (start >= end) return make_literal(Value::make_nil(), line);
+    if (end - start == 1) return parse_token(t[start], line);
+
+    // ( expr )
+    if (t[start] == "(" && matching_close(t, start, end) == end - 1) {
+        return parse_expr(t, start+1, end-1, line);
+    }
+
+    // Comparisons bind loosest: a plus 1 morethan b is (a plus 1) morethan b
+    if (end - start > 3) {
+        int depth = 0;
+        for (size_t i = start; i < end; ++i) {
+            if (t[i] == "(" || t[i] == "[") ++depth;
+            else if (t[i] == ")" || t[i] == "]") --depth;
+            else if (depth == 0 && i > start && is_comparison_op(op_from_word(t[i]))) {
+                return make_binary(parse_expr(t, start, i, line), t[i], parse_expr(t, i+1, end, line), line);
+            }
+        }
+    }
+
+    // f(args), m[key] or obj.method(args), optionally followed by: op rest
+    size_t after = start;
+    ExprPtr operand = parse_postfix(t, start, end, after, line);
+    if (operand) {
+        if (after + 1 < end) return make_binary(operand, t[after], parse_expr(t, after+1, end, line), line);
+        return operand;
+    }
+
+    // Simple binary: left op right
+    if (end - start == 3) {
+        return make_binary(parse_token(t[start], line), t[start+1], parse_token(t[start+2], line), line);
+    }
+
+    // Split at the first arithmetic operator
+    int depth = 0;
+    for (size_t i = start; i < end; ++i) {
+        if (t[i] == "(" || t[i] == "[") ++depth;
+        else if (t[i] == ")" || t[i] == "]") --depth;
+        else if (depth == 0 && is_arith_word(t[i])) {
+            return make_binary(parse_expr(t, start, i, line), t[i], parse_expr(t, i+1, end, line), line);
+        }
+    }
+
+    return parse_token(t[start], line);
+}
+
+static size_t find_token(const Tokens &t, const std::string &word, size_t from = 0) {
+    for (size_t k = from; k < t.size(); ++k) {
+        if (t[k] == word) return k;
+    }
+    return t.size();
+}
+
+static Block parse_block(const Lines &lines, size_t &i, bool stop_at_otherwise);
+
+// Parses the body after a block header at lines[i]; leaves i past its "done"
+static Block parse_body(const Lines &lines, size_t &i) {
+    ++i;
+    Block body = parse_block(lines, i, false);
+    if (i < lines.size()) ++i; // skip done
+    return body;
+}
+
+// make statements
+static StmtPtr parse_make(const Tokens &toks, int line) {
+    auto s = std::make_shared<Stmt>();
+    s->kind = Stmt::Kind::Make;
+    s->line = line;
+
+    // Shorthand: make <name> is <expr>
+    if (toks.size() >= 3 && toks[2] == "is") {
+        s->name = toks[1];
+        s->expr = parse_expr(toks, 3, toks.size(), line);
+        return s;
+    }
+
+    s->type = toks[1];
+    s->name = (toks.size() >= 3) ? toks[2] : "";
+
+    // make heap|maxheap <name> [by <key function>]
+    if (s->type == "heap" || s->type == "maxheap") {
+        if (toks.size() >= 5 && toks[3] == "by") s->expr = parse_expr(toks, 4, toks.size(), line);
+        return s;
+    }
+    size_t eq = find_token(toks, "=");
+    if (eq >= toks.size()) return s;
+
+    if ((s->type == "list" || s->type == "numbers") && eq + 1 < toks.size() && toks[eq+1] == "[") {
+        // Literal elements are single tokens
+        s->literal_list = true;
+        size_t close = find_token(toks, "]", eq+1);
+        bool constant = true;
+        for (size_t k = eq + 2; k < close; ++k) {
+            if (toks[k] == ",") continue;
+            ExprPtr item = parse_token(toks[k], line);
+            if (item->kind != Expr::Kind::Literal) constant = false;
+            s->items.push_back(item);
+        }
+        if (constant) {
+            for (auto &item : s->items) {
+                if (s->type == "numbers") s->literal_numbers.push_back(item->literal.as_number());
+                else s->literal_values.push_back(item->literal);
+            }
+            s->items.clear();
+        }
+        return s;
+    }
+    s->expr = parse_expr(toks, eq + 1, toks.size(), line);
+    return s;
+}
+
+// show parts: comma-separated expressions; a piece made only of plain
+// values (show a b) shows every token on its own
+static StmtPtr parse_show(const Tokens &toks, int line) {
+    auto s = std::make_shared<Stmt>();
+    s->kind = Stmt::Kind::Show;
+    s->line = line;
+    for (size_t j = 1; j < toks.size();) {
+        if (toks[j] == ";" || toks[j] == ",") {
+            s->show_parts += toks[j];
+            ++j;
+            continue;
+        }
+        size_t piece_end = j;
+        int depth = 0;
+        bool simple = true;
+        while (piece_end < toks.size()) {
+            const std::string &t = toks[piece_end];
+            if (depth == 0 && (t == "," || t == ";")) break;
+            if (t == "(" || t == "[") ++depth;
+            if (t == ")" || t == "]") --depth;
+            if (t == "(" || t == "[" || t == "." || op_from_word(t) != Op::Unknown) simple = false;
+            ++piece_end;
+        }
+        if (simple) {
+            for (; j < piece_end; ++j) {
+                s->items.push_back(parse_token(toks[j], line));
+                s->show_parts += 'e';
+            }
+        } else {
+            s->items.push_back(parse_expr(toks, j, piece_end, line));
+            s->show_parts += 'e';
+            j = piece_end;
+        }
+    }
+    return s;
+}
+
+// One statement starting at lines[i]; advances i past it (and past the
+// whole block for block statements). Returns null for lines that do nothing.
+static StmtPtr parse_stmt(const Lines &lines, size_t &i) {
+    const Tokens &toks = lines[i];
+    int line = (int)i + 1;
+    auto s = std::make_shared<Stmt>();
+    s->line = line;
+
+    // make <type> <name> [= value]
+    if (toks[0] == "make" && toks.size() >= 2) {
+        ++i;
+        return parse_make(toks, line);
+    }
+
+    // show <values...>
+    if (toks[0] == "show") {
+        ++i;
+        return parse_show(toks, line);
+    }
+
+    // put <value> into <container>
+    size_t into = find_token(toks, "into");
+    if (toks[0] == "put" && into + 1 < toks.size() && into > 1) {
+        s->kind = Stmt::Kind::Put;
+        s->expr = parse_expr(toks, 1, into, line);
+        s->name = toks[into+1];
+        ++i;
+        return s;
+    }
+
+    // takeout <container>
+    if (toks[0] == "takeout" && toks.size() >= 2) {
+        s->kind = Stmt::Kind::Takeout;
+        s->name = toks[1];
+        ++i;
+        return s;
+    }
+
+    // when <condition> ... [otherwise ...] done
+    if (toks[0] == "when") {
+        s->kind = Stmt::Kind::When;
+        s->expr = parse_expr(toks, 1, toks.size(), line);
+        ++i;
+        s->body = parse_block(lines, i, true);
+        if (i < lines.size() && lines[i][0] == "otherwise") {
+            ++i;
+            s->else_body = parse_block(lines, i, false);
+        }
+        if (i < lines.size()) ++i; // skip done
+        return s;
+    }
+
+    // [parallel] for [each] <var> in <expr> ... done
+    // for <var> from <a> to <b> [step <s>] ... done  (a and b both included)
+    bool parallel = (toks[0] == "parallel" && toks.size() >= 2 && toks[1] == "for");
+    if ((toks[0] == "for" || parallel) && toks.size() >= 4) {
+        size_t f = parallel ? 1 : 0;
+        size_t v = (toks[f+1] == "each") ? f+2 : f+1;
+        if (v+2 >= toks.size() || (toks[v+1] != "in" && toks[v+1] != "from")) { ++i; return nullptr; }
+        s->name = toks[v];
+        s->parallel = parallel;
+        if (toks[v+1] == "in") {
+            s->kind = Stmt::Kind::ForEach;
+            s->expr = parse_expr(toks, v+2, toks.size(), line);
+        } else {
+            s->kind = Stmt::Kind::ForRange;
+            size_t to = find_token(toks, "to", v+2);
+            size_t step = find_token(toks, "step", v+2);
+            s->expr = parse_expr(toks, v+2, to, line);
+            s->expr2 = parse_expr(toks, to+1, step, line);
+            if (step < toks.size()) s->expr3 = parse_expr(toks, step+1, toks.size(), line);
+        }
+        s->body = parse_body(lines, i);
+        return s;
+    }
+
+    // repeat <n> times ... done
+    if (toks[0] == "repeat" && toks.size() >= 3 && toks.back() == "times") {
+        s->kind = Stmt::Kind::Repeat;
+        s->expr = parse_expr(toks, 1, toks.size()-1, line);
+        s->body = parse_body(lines, i);
+        return s;
+    }
+
+    // sum <expr> into <name>, count into <name>, collect <expr> into <name>
+    if ((toks[0] == "sum" || toks[0] == "count" || toks[0] == "collect") && toks.size() >= 3 && toks[toks.size()-2] == "into") {
+        s->kind = Stmt::Kind::Reduce;
+        s->type = toks[0];
+        s->name = toks.back();
+        if (toks[0] != "count") s->expr = parse_expr(toks, 1, toks.size()-2, line);
+        ++i;
+        return s;
+    }
+
+    // define <name> [with <arg>] ... done
+    if (toks[0] == "define" && toks.size() >= 2) {
+        s->kind = Stmt::Kind::Define;
+        s->name = toks[1];
+        if (toks.size() >= 4 && toks[2] == "with") s->type = toks[3];
+        s->body = parse_body(lines, i);
+        return s;
+    }
+
+    // giveback <expr>
+    if (toks[0] == "giveback") {
+        s->kind = Stmt::Kind::Giveback;
+        s->expr = parse_expr(toks, 1, toks.size(), line);
+        ++i;
+        return s;
+    }
+
+    // load list|numbers|lines|map|graph <name> from <file>
+    size_t from = find_token(toks, "from");
+    if (toks[0] == "load" && toks.size() >= 5 && from == 3) {
+        s->kind = Stmt::Kind::Load;
+        s->type = toks[1];
+        s->name = toks[2];
+        s->expr = parse_expr(toks, 4, toks.size(), line);
+        ++i;
+        return s;
+    }
+
+    // save <value> to <file>
+    size_t to = find_token(toks, "to");
+    if (toks[0] == "save" && to > 1 && to + 1 < toks.size()) {
+        s->kind = Stmt::Kind::Save;
+        s->expr = parse_expr(toks, 1, to, line);
+        s->expr2 = parse_expr(toks, to+1, toks.size(), line);
+        ++i;
+        return s;
+    }
+
+    // snapshot <file>, restore <file>
+    if ((toks[0] == "snapshot" || toks[0] == "restore") && toks.size() >= 2 && toks[1] != "." && toks[1] != "[") {
+        s->kind = toks[0] == "snapshot" ? Stmt::Kind::Snapshot : Stmt::Kind::Restore;
+        s->expr = parse_expr(toks, 1, toks.size(), line);
+        ++i;
+        return s;
+    }
+
+    // Map subscript assignment: mp["key"] = value
+    if (toks.size() >= 5 && toks[1] == "[") {
+        size_t close = matching_close(toks, 1, toks.size());
+        if (close + 1 < toks.size() && toks[close+1] == "=") {
+            s->kind = Stmt::Kind::SetIndex;
+            s->name = toks[0];
+            s->expr2 = parse_expr(toks, 2, close, line);
+            if (s->expr2->kind == Expr::Kind::Var) s->expr2->name_fallback = true;
+            s->expr = parse_expr(toks, close+2, toks.size(), line);
+            ++i;
+            return s;
+        }
+    }
+
+    // obj.method(args) or f(args) run for their effect
+    if (toks.size() >= 3 && (toks[1] == "." || toks[1] == "(")) {
+        s->kind = Stmt::Kind::Eval;
+        s->expr = parse_expr(toks, 0, toks.size(), line);
+        ++i;
+        return s;
+    }
+
+    // start program / end program and anything unrecognised
+    ++i;
+    return nullptr;
+}
+
+// Statements up to the "done" (or "otherwise") that closes this block
+static Block parse_block(const Lines &lines, size_t &i, bool stop_at_otherwise) {
+    Block block;
+    while (i < lines.size()) {
+        const Tokens &toks = lines[i];
+        if (toks.empty()) { ++i; continue; }
+        if (toks[0] == "done") break;
+        if (toks[0] == "otherwise" && stop_at_otherwise) break;
+        if (toks[0] == "otherwise") { ++i; continue; }
+        StmtPtr s = parse_stmt(lines, i);
+        if (s) block.push_back(s);
+    }
+    return block;
+}
+
+// Whether a memstats() call appears anywhere, define bodies included
+static bool calls_memstats(const ExprPtr &e) {
+    if (!e) return false;
+    if (e->kind == Expr::Kind::Call && e->name == "memstats" && e->args.empty()) return true;
+    for (auto &a : e->args) {
+        if (calls_memstats(a)) return true;
+    }
+    return false;
+}
+
+static bool calls_memstats(const Block &block) {
+    for (auto &s : block) {
+        if (calls_memstats(s->expr) || calls_memstats(s->expr2) || calls_memstats(s->expr3)) return true;
+        for (auto &item : s->items) {
+            if (calls_memstats(item)) return true;
+        }
+        if (calls_memstats(s->body) || calls_memstats(s->else_body)) return true;
+    }
+    return false;
+}
+
+std::shared_ptr<Program> parse_program(const std::vector<std::vector<std::string>> &lines) {
+    auto prog = std::make_shared<Program>();
+    size_t i = 0;
+    while (i < lines.size()) {
+        Block part = parse_block(lines, i, false);
+        prog->body.insert(prog->body.end(), part.begin(), part.end());
+        if (i < lines.size()) ++i; // stray done at top level
+    }
+    prog->uses_memstats = calls_memstats(prog->body);
+    return prog;
+}
+
+// Whether parse_stmt reads a body up to a "done" after this line; kept in
+// step with the block statements above
+static bool opens_block(const Tokens &toks) {
+    if (toks.empty()) return false;
+    if (toks[0] == "when") return true;
+    if (toks[0] == "define") return toks.size() >= 2;
+    if (toks[0] == "repeat") return toks.size() >= 3 && toks.back() == "times";
+    bool parallel = (toks[0] == "parallel" && toks.size() >= 2 && toks[1] == "for");
+    if ((toks[0] == "for" || parallel) && toks.size() >= 4) {
+        size_t f = parallel ? 1 : 0;
+        size_t v = (toks[f+1] == "each") ? f+2 : f+1;
+        return v+2 < toks.size() && (toks[v+1] == "in" || toks[v+1] == "from");
+    }
+    return false;
+}
+
+int open_blocks(const std::vector<std::vector<std::string>> &lines) {
+    int depth = 0;
+    for (auto &toks : lines) {
+        if (opens_block(toks)) ++depth;
+        else if (!toks.empty() && toks[0] == "done" && depth > 0) --depth;
+    }
+    return depth;
+}
+
+// Source-like text for an expression (used by --dump-opt)
+std::string expr_to_string(const Expr &e) {
+    switch (e.kind) {
+        case Expr::Kind::Literal:
+            if (e.literal.type == Value::Type::Word) return "\"" + e.literal.as_word().str() + "\"";
+            return e.literal.to_string();
+        case Expr::Kind::Var:
+            return e.name;
+        case Expr::Kind::Binary: {
+            std::string l = expr_to_string(*e.args[0]);
+            if (e.args[0]->kind == Expr::Kind::Binary) l = "(" + l + ")";
+            return l + " " + e.name + " " + expr_to_string(*e.args[1]);
+        }
+        case Expr::Kind::Call:
+        case Expr::Kind::Method: {
+            bool method = (e.kind == Expr::Kind::Method);
+            std::string s = method ? expr_to_string(*e.args[0]) + "." + e.name : e.name;
+            if (method && !e.parens) return s;
+            s += "(";
+            for (size_t k = method ? 1 : 0; k < e.args.size(); ++k) {
+                if (k > (method ? 1u : 0u)) s += ", ";
+                s += expr_to_string(*e.args[k]);
+            }
+            return s + ")";
+        }
+        case Expr::Kind::Subscript:
+            return expr_to_string(*e.args[0]) + "[" + expr_to_string(*e.args[1]) + "]";
+    }
+    return "?";
+}
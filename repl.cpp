@@ -0,0 +1,81 @@
+// repl.cpp
+// The interactive front end: gathers multi-line entries, compiles each
+// distinct entry once, runs it in the global scope and times it on request.
+
+#include "repl.hpp"
+#include <chrono>
+#include <cstdio>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double ms_since(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+std::string ms_text(double ms) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.3f ms", ms);
+    return buf;
+}
+
+} // namespace
+
+void Repl::feed(const std::string &line) {
+    if (pending.empty()) {
+        size_t first = line.find_first_not_of(" \t");
+        if (first == std::string::npos) return;
+        if (line[first] == ':') {
+            command(line.substr(first));
+            return;
+        }
+    }
+    pending += line;
+    pending += '\n';
+    if (open_blocks(lex_source(pending)) > 0) return;
+    std::string source;
+    source.swap(pending);
+    run_entry(source, timing);
+}
+
+void Repl::command(const std::string &line) {
+    size_t space = line.find_first_of(" \t");
+    std::string name = line.substr(0, space);
+    std::string rest = space == std::string::npos ? "" : line.substr(line.find_first_not_of(" \t", space));
+    if (name != ":time") throw std::runtime_error("unknown command " + name + ", try :time");
+    if (rest.empty()) {
+        timing = !timing;
+        notes << "timing is " << (timing ? "on" : "off") << std::endl;
+        return;
+    }
+    std::string source = rest + "\n";
+    if (open_blocks(lex_source(source)) > 0) throw std::runtime_error(":time takes one line; turn on :time to time a block");
+    run_entry(source, true);
+}
+
+void Repl::run_entry(const std::string &source, bool timed) {
+    Clock::time_point start = Clock::now();
+    auto it = compiled.find(source);
+    bool reused = it != compiled.end();
+    std::shared_ptr<const Program> prog;
+    if (reused) {
+        prog = it->second;
+    } else {
+        prog = Interpreter::compile(source);
+        compiled.emplace(source, prog);
+        for (auto &warning : prog->warnings) notes << "warning: " << warning << std::endl;
+        if (dump_opt) {
+            for (auto &note : prog->opt_report) notes << "opt: " << note << std::endl;
+        }
+    }
+    double compile_ms = ms_since(start);
+
+    Clock::time_point run_start = Clock::now();
+    Value ret = interp.run_global(*prog);
+    double run_ms = ms_since(run_start);
+    if (ret.type != Value::Type::Nil) interp.output() << ret.to_string() << std::endl;
+    if (timed) {
+        notes << "time: " << ms_text(run_ms) << " (compile " << (reused ? "reused" : ms_text(compile_ms)) << ")" << std::endl;
+    }
+}
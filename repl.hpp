@@ -0,0 +1,40 @@
+// SimpliC Language - Interactive Sessions (the REPL)
+#pragma once
+
+#include "interpreter.hpp"
+#include <string>
+#include <unordered_map>
+
+// Runs statements typed one line at a time against an Interpreter's global
+// scope. Lines are gathered until every define, when, for and repeat they
+// open has its "done", then the whole entry runs at once. Each entry is
+// compiled once and kept: the session holds on to every program it made,
+// so functions defined in it and the word constants they use stay alive,
+// and typing the same entry again runs it without compiling it again.
+//
+// Lines starting with ':' are commands:
+//   :time              turns timing of each entry on or off
+//   :time <statement>  runs one statement and times it
+class Repl {
+public:
+    // Giveback values go to interp's output; warnings, --dump-opt notes and
+    // timings go to notes
+    Repl(Interpreter &interp, std::ostream &notes, bool dump_opt = false)
+        : interp(interp), notes(notes), dump_opt(dump_opt) {}
+
+    // Takes one line of input; errors throw, and drop the unfinished entry
+    void feed(const std::string &line);
+    // Whether an entry is still open, waiting for more lines
+    bool continuing() const { return !pending.empty(); }
+
+private:
+    Interpreter &interp;
+    std::ostream &notes;
+    bool dump_opt;
+    bool timing = false;
+    std::string pending;  // lines of the open entry
+    std::unordered_map<std::string, std::shared_ptr<const Program>> compiled;  // entry -> its program
+
+    void command(const std::string &line);
+    void run_entry(const std::string &source, bool timed);
+};
@@ -8,6 +8,9 @@
 #include <functional>
 #include <sstream>
 #include <iostream>
+#include "hashmap.hpp"
+#include "memstats.hpp"
+#include "text.hpp"
 
 // Forward declarations
 struct Value;
@@ -19,18 +22,28 @@ struct SimpliSet;
 struct SimpliMap;
 struct BST;
 struct Graph;
+struct NumArray;
+struct Sequence;
+struct Heap;
 
 using Number = double;
-using Word = std::string;
+using Word = Text;
 using YesNo = bool;
 using List = std::vector<Value>;
-using Map = std::unordered_map<std::string, Value>;
+using Map = HashMap<Value>;
+
+// Cycle collector of the Interpreter running on this thread (gc.cpp);
+// new containers and shared scopes are handed to it while it is set
+class Collector;
+extern thread_local Collector *current_collector;
+void gc_adopt(const Value &v);
+void gc_adopt(const std::shared_ptr<Environment> &env);
 
 // Value type - can hold any SimpliC data type
 struct Value {
     enum class Type {
         Nil, Number, Word, YesNo, List, Map, Function,
-        Stack, Queue, LinkedList, Set, BST, Graph
+        Stack, Queue, LinkedList, Set, BST, Graph, Numbers, Sequence, Heap
     } type = Type::Nil;
     
     Number number_value = 0.0;
@@ -39,49 +52,101 @@ struct Value {
     std::shared_ptr<List> list_value;
     std::shared_ptr<Map> map_value;
     std::function<Value(std::vector<Value>)> func_value;
+    std::shared_ptr<Environment> func_env;  // shared scope a closure keeps alive
     std::shared_ptr<::Stack> stack_value;
     std::shared_ptr<::Queue> queue_value;
     std::shared_ptr<::LinkedList> linklist_value;
     std::shared_ptr<::SimpliSet> set_value;
     std::shared_ptr<::BST> bst_value;
     std::shared_ptr<::Graph> graph_value;
+    std::shared_ptr<::NumArray> numbers_value;
+    std::shared_ptr<::Sequence> seq_value;
+    std::shared_ptr<::Heap> heap_value;
 
     Value() = default;
     static Value make_nil() { return Value(); }
     static Value from_number(Number n) { Value a; a.type = Type::Number; a.number_value = n; return a; }
     static Value from_word(const Word &s) { Value a; a.type = Type::Word; a.word_value = s; return a; }
     static Value from_yesno(bool b) { Value a; a.type = Type::YesNo; a.yesno_value = b; return a; }
-    static Value from_list(const List &l) { Value a; a.type = Type::List; a.list_value = std::make_shared<List>(l); return a; }
-    static Value from_map(const Map &m) { Value a; a.type = Type::Map; a.map_value = std::make_shared<Map>(m); return a; }
-    static Value from_function(std::function<Value(std::vector<Value>)> f) { Value a; a.type = Type::Function; a.func_value = f; return a; }
-    static Value from_stack(std::shared_ptr<::Stack> s) { Value a; a.type = Type::Stack; a.stack_value = s; return a; }
-    static Value from_queue(std::shared_ptr<::Queue> q) { Value a; a.type = Type::Queue; a.queue_value = q; return a; }
+    static Value from_list(const List &l) { Value a; a.type = Type::List; a.list_value = make_tracked<List>(l); adopt(a); return a; }
+    static Value from_map(const Map &m) { Value a; a.type = Type::Map; a.map_value = make_tracked<Map>(m); adopt(a); return a; }
+    static Value from_function(std::function<Value(std::vector<Value>)> f, std::shared_ptr<Environment> env = nullptr) { Value a; a.type = Type::Function; a.func_value = f; a.func_env = env; return a; }
+    static Value from_stack(std::shared_ptr<::Stack> s) { Value a; a.type = Type::Stack; a.stack_value = s; adopt(a); return a; }
+    static Value from_queue(std::shared_ptr<::Queue> q) { Value a; a.type = Type::Queue; a.queue_value = q; adopt(a); return a; }
     static Value from_linklist(std::shared_ptr<::LinkedList> ll) { Value a; a.type = Type::LinkedList; a.linklist_value = ll; return a; }
     static Value from_set(std::shared_ptr<::SimpliSet> st) { Value a; a.type = Type::Set; a.set_value = st; return a; }
     static Value from_bst(std::shared_ptr<::BST> bst) { Value a; a.type = Type::BST; a.bst_value = bst; return a; }
     static Value from_graph(std::shared_ptr<::Graph> g) { Value a; a.type = Type::Graph; a.graph_value = g; return a; }
+    static Value from_numbers(std::shared_ptr<::NumArray> n) { Value a; a.type = Type::Numbers; a.numbers_value = n; return a; }
+    static Value from_sequence(std::shared_ptr<::Sequence> s) { Value a; a.type = Type::Sequence; a.seq_value = s; adopt(a); return a; }
+    static Value from_heap(std::shared_ptr<::Heap> h) { Value a; a.type = Type::Heap; a.heap_value = h; adopt(a); return a; }
 
     Number as_number() const { return number_value; }
-    Word as_word() const { return word_value; }
+    const Word &as_word() const { return word_value; }
     YesNo as_yesno() const { return yesno_value; }
     List &as_list() { return *list_value; }
     const List &as_list() const { return *list_value; }
     Map &as_map() { return *map_value; }
+    const Map &as_map() const { return *map_value; }
 
     std::string to_string() const;
+
+private:
+    // Containers that can hold other values are the ones that can form cycles
+    static void adopt(const Value &v) { if (current_collector) gc_adopt(v); }
+};
+
+// Lazy sequence - a number range or a list/numbers value, plus map and filter
+// steps. Nothing is built up front: each element goes through every step in
+// one pass while the sequence is consumed.
+struct Sequence {
+    bool is_range = true;
+    Number start = 0, step = 1;  // range: count numbers from start, step apart
+    size_t count = 0;
+    Value source;                // List or Numbers when !is_range
+    std::vector<std::pair<bool, Value>> stages;  // (is_filter, function)
+
+    static std::shared_ptr<Sequence> range(Number start, Number stop, Number step, bool inclusive);
+    // Calls f on each element that makes it through the steps; f returns
+    // false to stop early
+    void each(const std::function<bool(const Value &)> &f) const;
+    std::shared_ptr<Sequence> with_stage(bool is_filter, const Value &fn) const;
 };
 
 // Environment - variable and function scope management
 struct Environment {
     std::unordered_map<std::string, Value> vars;
     Environment *parent = nullptr;
+    // Only for scopes made by shared(): closures defined in them hold on to
+    // them, and they hold on to their parent the same way
+    std::weak_ptr<Environment> self;
+    std::shared_ptr<Environment> keep_parent;
+    MemTag mem_tag;
+
+    Environment(Environment *p = nullptr) : parent(p), mem_tag(MemKind::Environment, sizeof(Environment)) {}
 
-    Environment(Environment *p = nullptr) : parent(p) {}
+    // A scope on the heap, for when closures defined in it may outlive the
+    // code that made it; keep is the parent's owner if it is shared too
+    static std::shared_ptr<Environment> shared(Environment *p, std::shared_ptr<Environment> keep) {
+        // Not make_shared, so the collector's weak_ptr does not keep it allocated
+        std::shared_ptr<Environment> env(new Environment(p));
+        env->self = env;
+        env->keep_parent = keep;
+        if (current_collector) gc_adopt(env);
+        return env;
+    }
 
     void set(const std::string &name, const Value &val) {
         vars[name] = val;
     }
 
+    // set() for a number; a slot that already holds one is just overwritten
+    void set_number(const std::string &name, Number n) {
+        auto it = vars.find(name);
+        if (it != vars.end() && it->second.type == Value::Type::Number) it->second.number_value = n;
+        else vars[name] = Value::from_number(n);
+    }
+
     bool exists_in_current(const std::string &name) const {
         return vars.find(name) != vars.end();
     }
@@ -95,6 +160,15 @@ struct Environment {
         if (parent) return parent->get(name, out);
         return false;
     }
+
+    // get() without the copy; null if the name is not set
+    const Value *find(const std::string &name) const {
+        for (const Environment *env = this; env; env = env->parent) {
+            auto it = env->vars.find(name);
+            if (it != env->vars.end()) return &it->second;
+        }
+        return nullptr;
+    }
 };
 
 // Interpreter function declarations
@@ -0,0 +1,457 @@
+// snapshot.cpp
+// Heap snapshots: every variable in scope, with everything it reaches,
+// written to one binary file and read back later. Each container is
+// written once and later mentions point back to it, so shared containers
+// stay shared and cycles come back as cycles. Bulk data (numbers, linked
+// list and set numbers, tree values, graph adjacency) is stored as raw
+// arrays that restoring copies straight out of the mapped file.
+// Functions are left out: they belong to the program, which makes them
+// again. Like the program cache, a snapshot is read back on the same kind
+// of machine that wrote it.
+
+#include "simplic.hpp"
+#include "dsa.hpp"
+#include "binfile.hpp"
+#include <cstdio>
+#include <map>
+#include <stdexcept>
+
+namespace {
+
+const char kMagic[8] = {'S', 'I', 'M', 'P', 'L', 'I', 'C', 'S'};
+const uint32_t kFormatVersion = 1;
+
+static_assert(sizeof(int) == 4, "graph nodes are stored as 4-byte ints");
+
+struct Header {
+    char magic[8];
+    uint32_t format;
+    uint32_t reserved;
+    uint64_t body_size;
+};
+
+// BST nodes in preorder: which children follow
+const unsigned char kHasLeft = 1, kHasRight = 2;
+
+// Writing
+
+class Writer : public ByteWriter {
+public:
+    void value(const Value &v) {
+        if (v.type == Value::Type::Function) {
+            u((uint64_t)Value::Type::Nil);
+            return;
+        }
+        u((uint64_t)v.type);
+        switch (v.type) {
+            case Value::Type::Nil: break;
+            case Value::Type::Number: d(v.as_number()); break;
+            case Value::Type::Word: s(v.word_value.str()); break;
+            case Value::Type::YesNo: u(v.as_yesno() ? 1 : 0); break;
+            case Value::Type::List:
+                if (written(v.list_value.get())) break;
+                u(v.as_list().size());
+                for (auto &item : v.as_list()) value(item);
+                break;
+            case Value::Type::Map:
+                if (written(v.map_value.get())) break;
+                u(v.as_map().size());
+                v.as_map().each([this](const std::string &k, const Value &item) {
+                    s(k);
+                    value(item);
+                });
+                break;
+            case Value::Type::Stack:
+                if (written(v.stack_value.get())) break;
+                u(v.stack_value->size());
+                for (auto &item : v.stack_value->data) value(item);
+                break;
+            case Value::Type::Queue: {
+                const Queue &q = *v.queue_value;
+                if (written(&q)) break;
+                u(q.spsc ? q.buf.size() : 0);
+                size_t n = q.size();
+                u(n);
+                for (size_t k = 0; k < n; ++k) value(q.peek(k));
+                break;
+            }
+            case Value::Type::LinkedList: {
+                if (written(v.linklist_value.get())) break;
+                std::vector<double> vals;
+                for (LLNode *node = v.linklist_value->head; node; node = node->next) vals.push_back(node->val);
+                doubles(vals);
+                break;
+            }
+            case Value::Type::Set: {
+                const SimpliSet &st = *v.set_value;
+                if (written(&st)) break;
+                doubles(std::vector<double>(st.nums.begin(), st.nums.end()));
+                u(st.words.size());
+                for (auto &w : st.words) s(w.str());
+                break;
+            }
+            case Value::Type::BST:
+                if (written(v.bst_value.get())) break;
+                bst(*v.bst_value);
+                break;
+            case Value::Type::Graph:
+                if (written(v.graph_value.get())) break;
+                graph(*v.graph_value);
+                break;
+            case Value::Type::Numbers:
+                if (written(v.numbers_value.get())) break;
+                doubles(v.numbers_value->data);
+                break;
+            case Value::Type::Sequence: {
+                const Sequence &seq = *v.seq_value;
+                if (written(&seq)) break;
+                if (!seq.stages.empty()) {
+                    // map and filter steps are functions: keep what they give
+                    List items;
+                    seq.each([&items](const Value &x) { items.push_back(x); return true; });
+                    u(2);
+                    u(items.size());
+                    for (auto &item : items) value(item);
+                } else if (seq.is_range) {
+                    u(1);
+                    d(seq.start);
+                    d(seq.step);
+                    u(seq.count);
+                } else {
+                    u(0);
+                    value(seq.source);
+                }
+                break;
+            }
+            case Value::Type::Heap: {
+                const Heap &h = *v.heap_value;
+                if (written(&h)) break;
+                if (h.key_fn) throw std::runtime_error("snapshot: a heap made with 'by' cannot be saved, its key is a function");
+                u(h.max_first ? 1 : 0);
+                List items = h.items_in_order();
+                u(items.size());
+                for (auto &item : items) value(item);
+                break;
+            }
+            case Value::Type::Function: break;
+        }
+    }
+
+private:
+    std::unordered_map<const void *, uint64_t> ids;
+
+    // Writes the object's id if it was written before (and returns true),
+    // or 0 and gives it the next id
+    bool written(const void *obj) {
+        auto it = ids.find(obj);
+        if (it != ids.end()) {
+            u(it->second);
+            return true;
+        }
+        u(0);
+        ids.emplace(obj, ids.size() + 1);
+        return false;
+    }
+
+    void doubles(const std::vector<double> &vals) {
+        u(vals.size());
+        raw(vals.data(), vals.size() * sizeof(double));
+    }
+
+    // Preorder, without recursion: a tree built from sorted input is a
+    // single long branch
+    void bst(const BST &tree) {
+        std::vector<unsigned char> flags;
+        std::vector<double> vals;
+        std::vector<const BSTNode *> todo;
+        if (tree.root) todo.push_back(tree.root);
+        while (!todo.empty()) {
+            const BSTNode *node = todo.back();
+            todo.pop_back();
+            flags.push_back((node->left ? kHasLeft : 0) | (node->right ? kHasRight : 0));
+            vals.push_back(node->val);
+            if (node->right) todo.push_back(node->right);
+            if (node->left) todo.push_back(node->left);
+        }
+        u(vals.size());
+        raw(flags.data(), flags.size());
+        raw(vals.data(), vals.size() * sizeof(double));
+    }
+
+    // Node ids, then each node's edge count, then every edge target
+    void graph(const Graph &g) {
+        std::vector<int> nodes;
+        std::vector<uint32_t> degrees;
+        size_t edges = 0;
+        nodes.reserve(g.adj.size());
+        degrees.reserve(g.adj.size());
+        for (auto &kv : g.adj) {
+            nodes.push_back(kv.first);
+            degrees.push_back((uint32_t)kv.second.size());
+            edges += kv.second.size();
+        }
+        u(nodes.size());
+        raw(nodes.data(), nodes.size() * sizeof(int));
+        raw(degrees.data(), degrees.size() * sizeof(uint32_t));
+        u(edges);
+        for (auto &kv : g.adj) raw(kv.second.data(), kv.second.size() * sizeof(int));
+    }
+};
+
+// Reading
+
+class Reader : public ByteReader {
+public:
+    Reader(const char *data, size_t size) : ByteReader(data, size, "snapshot") {}
+
+    Value value() {
+        uint64_t type = u();
+        if (type > (uint64_t)Value::Type::Heap || type == (uint64_t)Value::Type::Function) fail("bad value");
+        Value::Type t = (Value::Type)type;
+        switch (t) {
+            case Value::Type::Nil: return Value::make_nil();
+            case Value::Type::Number: return Value::from_number(d());
+            case Value::Type::Word: return Value::from_word(word());
+            case Value::Type::YesNo: return Value::from_yesno(u() != 0);
+            default: break;
+        }
+
+        uint64_t id = u();
+        if (id != 0) {
+            if (id > objects.size() || objects[id - 1].type != t) fail("bad reference");
+            return objects[id - 1];
+        }
+        // Registered before its contents are read, so they can point back
+        // to it
+        Value v = make_empty(t);
+        objects.push_back(v);
+        switch (t) {
+            case Value::Type::List: {
+                List &items = v.as_list();
+                items.resize(count());
+                for (auto &item : items) item = value();
+                break;
+            }
+            case Value::Type::Map: {
+                Map &m = v.as_map();
+                size_t n = count();
+                m.reserve(n);
+                for (size_t k = 0; k < n; ++k) {
+                    std::string key = s();
+                    m[key] = value();
+                }
+                break;
+            }
+            case Value::Type::Stack: {
+                std::vector<Value> &data = v.stack_value->data;
+                data.resize(count());
+                for (auto &item : data) item = value();
+                break;
+            }
+            case Value::Type::Queue: {
+                Queue &q = *v.queue_value;
+                size_t capacity = count();
+                size_t n = count();
+                if (capacity) {
+                    if (n > capacity) fail("bad queue");
+                    q.make_spsc(capacity);
+                } else {
+                    q.reserve(n);
+                }
+                for (size_t k = 0; k < n; ++k) q.push(value());
+                break;
+            }
+            case Value::Type::LinkedList: {
+                std::vector<double> vals = doubles();
+                LLNode **tail = &v.linklist_value->head;
+                for (double x : vals) {
+                    *tail = new LLNode(x);
+                    tail = &(*tail)->next;
+                }
+                break;
+            }
+            case Value::Type::Set: {
+                SimpliSet &st = *v.set_value;
+                // Stored sorted, so each insert lands at the end
+                for (double x : doubles()) st.nums.insert(st.nums.end(), x);
+                size_t n = count();
+                for (size_t k = 0; k < n; ++k) st.words.insert(st.words.end(), word());
+                break;
+            }
+            case Value::Type::BST:
+                bst(*v.bst_value);
+                break;
+            case Value::Type::Graph:
+                graph(*v.graph_value);
+                break;
+            case Value::Type::Numbers:
+                v.numbers_value->data = doubles();
+                break;
+            case Value::Type::Sequence: {
+                Sequence &seq = *v.seq_value;
+                uint64_t kind = u();
+                if (kind == 1) {
+                    seq.is_range = true;
+                    seq.start = d();
+                    seq.step = d();
+                    seq.count = (size_t)u();
+                } else if (kind == 0 || kind == 2) {
+                    seq.is_range = false;
+                    if (kind == 0) {
+                        seq.source = value();
+                        if (seq.source.type != Value::Type::List && seq.source.type != Value::Type::Numbers) fail("bad sequence");
+                    } else {
+                        seq.source = Value::from_list(List());
+                        List &items = seq.source.as_list();
+                        items.resize(count());
+                        for (auto &item : items) item = value();
+                    }
+                } else {
+                    fail("bad sequence");
+                }
+                break;
+            }
+            case Value::Type::Heap: {
+                Heap &h = *v.heap_value;
+                h.max_first = u() != 0;
+                List items(count());
+                for (auto &item : items) item = value();
+                h.heapify(items);
+                break;
+            }
+            default:
+                break;
+        }
+        return v;
+    }
+
+private:
+    std::vector<Value> objects;  // by id - 1
+
+    static Value make_empty(Value::Type t) {
+        switch (t) {
+            case Value::Type::List: return Value::from_list(List());
+            case Value::Type::Map: return Value::from_map(Map());
+            case Value::Type::Stack: return Value::from_stack(make_tracked<Stack>());
+            case Value::Type::Queue: return Value::from_queue(make_tracked<Queue>());
+            case Value::Type::LinkedList: return Value::from_linklist(make_tracked<LinkedList>());
+            case Value::Type::Set: return Value::from_set(make_tracked<SimpliSet>());
+            case Value::Type::BST: return Value::from_bst(make_tracked<BST>());
+            case Value::Type::Graph: return Value::from_graph(make_tracked<Graph>());
+            case Value::Type::Numbers: return Value::from_numbers(make_tracked<NumArray>());
+            case Value::Type::Sequence: return Value::from_sequence(make_tracked<Sequence>());
+            default: return Value::from_heap(make_tracked<Heap>());
+        }
+    }
+
+    Word word() {
+        uint64_t n = u();
+        return Word(raw(n), (size_t)n);
+    }
+
+    std::vector<double> doubles() {
+        size_t n = count();
+        std::vector<double> out(n);
+        std::memcpy(out.data(), raw((uint64_t)n * sizeof(double)), n * sizeof(double));
+        return out;
+    }
+
+    // Rebuilds the preorder written by Writer::bst; each node fills the
+    // child slot that was waiting longest on its side of the stack
+    void bst(BST &tree) {
+        size_t n = count();
+        const char *flags = raw(n);
+        const char *vals = raw((uint64_t)n * sizeof(double));
+        std::vector<BSTNode **> slots;
+        if (n) slots.push_back(&tree.root);
+        for (size_t k = 0; k < n; ++k) {
+            if (slots.empty()) fail("bad tree");
+            BSTNode **slot = slots.back();
+            slots.pop_back();
+            double x;
+            std::memcpy(&x, vals + k * sizeof(double), sizeof(double));
+            *slot = new BSTNode(x);
+            unsigned char f = (unsigned char)flags[k];
+            if (f & kHasRight) slots.push_back(&(*slot)->right);
+            if (f & kHasLeft) slots.push_back(&(*slot)->left);
+        }
+        if (!slots.empty()) fail("bad tree");
+    }
+
+    void graph(Graph &g) {
+        size_t n = count();
+        const char *nodes = raw((uint64_t)n * sizeof(int));
+        const char *degrees = raw((uint64_t)n * sizeof(uint32_t));
+        uint64_t edges = u();
+        const char *targets = raw(edges * sizeof(int));
+        g.adj.reserve(n);
+        uint64_t used = 0;
+        for (size_t k = 0; k < n; ++k) {
+            int node;
+            uint32_t degree;
+            std::memcpy(&node, nodes + k * sizeof(int), sizeof(int));
+            std::memcpy(&degree, degrees + k * sizeof(uint32_t), sizeof(uint32_t));
+            if (degree > edges - used) fail("bad graph");
+            std::vector<int> &out = g.adj[node];
+            out.resize(degree);
+            if (degree) std::memcpy(out.data(), targets + used * sizeof(int), degree * sizeof(int));
+            used += degree;
+        }
+        if (used != edges) fail("bad graph");
+    }
+};
+
+} // namespace
+
+void save_snapshot(const Environment &env, const std::string &path) {
+    // Inner scopes hide outer ones; the hoisted temporaries of loops still
+    // running (a snapshot in a loop body) are left out
+    std::map<std::string, const Value *> vars;
+    for (const Environment *e = &env; e; e = e->parent) {
+        for (auto &kv : e->vars) {
+            if (kv.first.empty() || kv.first[0] == '(' || kv.second.type == Value::Type::Function) continue;
+            vars.insert(std::make_pair(kv.first, &kv.second));
+        }
+    }
+    Writer w;
+    w.u(vars.size());
+    for (auto &kv : vars) {
+        w.s(kv.first);
+        w.value(*kv.second);
+    }
+
+    Header h;
+    std::memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.format = kFormatVersion;
+    h.reserved = 0;
+    h.body_size = w.out.size();
+
+    FILE *f = std::fopen(path.c_str(), "wb");
+    if (!f) throw std::runtime_error("could not write file: " + path);
+    bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1 &&
+              std::fwrite(w.out.data(), 1, w.out.size(), f) == w.out.size();
+    ok = (std::fclose(f) == 0) && ok;
+    if (!ok) throw std::runtime_error("could not write file: " + path);
+}
+
+void restore_snapshot(Environment &env, const std::string &path) {
+    MappedFile file(path);
+    if (!file.data) throw std::runtime_error("could not open file: " + path);
+    Header h;
+    if (file.size < sizeof(Header)) throw std::runtime_error("snapshot: " + path + " is not a snapshot");
+    std::memcpy(&h, file.data, sizeof(Header));
+    if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0) throw std::runtime_error("snapshot: " + path + " is not a snapshot");
+    if (h.format != kFormatVersion) throw std::runtime_error("snapshot: " + path + " was written by another version");
+    if (h.body_size != file.size - sizeof(Header)) throw std::runtime_error("snapshot: " + path + " is cut short");
+
+    // Everything is read before any variable changes, so a damaged file
+    // leaves the scope as it was
+    Reader in(file.data + sizeof(Header), (size_t)h.body_size);
+    std::vector<std::pair<std::string, Value>> vars(in.count());
+    for (auto &kv : vars) {
+        kv.first = in.s();
+        kv.second = in.value();
+    }
+    if (!in.done()) in.fail("bad file");
+    for (auto &kv : vars) env.set(kv.first, kv.second);
+}
@@ -0,0 +1,228 @@
+// sort.cpp
+// List sorting: a total order over Values, an LSD radix sort for lists that
+// hold only numbers, and a parallel merge sort for large general lists that
+// runs on the parallel_for pool.
+
+#include "simplic.hpp"
+#include "dsa.hpp"
+#include "parallel.hpp"
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+
+namespace {
+
+const size_t kRadixMin = 256;         // below this std::sort wins
+const size_t kParallelMin = 1 << 16;  // below this threads cost more than they save
+
+// Rank of each type in the total order
+int type_rank(Value::Type t) {
+    switch (t) {
+        case Value::Type::Nil: return 0;
+        case Value::Type::YesNo: return 1;
+        case Value::Type::Number: return 2;
+        case Value::Type::Word: return 3;
+        case Value::Type::List: return 4;
+        case Value::Type::Numbers: return 5;
+        default: return 6 + (int)t;
+    }
+}
+
+int compare_numbers(double x, double y) {
+    bool xn = std::isnan(x), yn = std::isnan(y);
+    if (xn || yn) return (int)xn - (int)yn;
+    return x < y ? -1 : (y < x ? 1 : 0);
+}
+
+// Maps a double other than NaN onto an unsigned key with the same order
+// (-0.0 just below 0.0); every bit is kept, so from_radix_key gives the same
+// double back
+uint64_t radix_key(double d) {
+    uint64_t bits;
+    std::memcpy(&bits, &d, sizeof bits);
+    return (bits & 0x8000000000000000ULL) ? ~bits : (bits | 0x8000000000000000ULL);
+}
+
+double from_radix_key(uint64_t key) {
+    uint64_t bits = (key & 0x8000000000000000ULL) ? (key & ~0x8000000000000000ULL) : ~key;
+    double d;
+    std::memcpy(&d, &bits, sizeof d);
+    return d;
+}
+
+// LSD radix sort over 8-bit digits; passes where every key shares the
+// digit are skipped, so narrow ranges (small integers) need few passes
+void radix_sort_keys(std::vector<uint64_t> &keys) {
+    size_t n = keys.size();
+    std::vector<uint64_t> buf(n);
+    size_t counts[8][256];
+    std::memset(counts, 0, sizeof counts);
+    for (uint64_t k : keys) {
+        for (int pass = 0; pass < 8; ++pass) ++counts[pass][(k >> (pass * 8)) & 0xFF];
+    }
+    uint64_t *src = keys.data(), *dst = buf.data();
+    for (int pass = 0; pass < 8; ++pass) {
+        size_t *c = counts[pass];
+        if (c[(src[0] >> (pass * 8)) & 0xFF] == n) continue;
+        size_t offset = 0;
+        for (int d = 0; d < 256; ++d) {
+            size_t cnt = c[d];
+            c[d] = offset;
+            offset += cnt;
+        }
+        for (size_t i = 0; i < n; ++i) dst[c[(src[i] >> (pass * 8)) & 0xFF]++] = src[i];
+        std::swap(src, dst);
+    }
+    if (src != keys.data()) std::memcpy(keys.data(), src, n * sizeof(uint64_t));
+}
+
+size_t worker_count(size_t n) {
+    if (n < kParallelMin) return 1;
+    size_t by_size = n / (kParallelMin / 2);
+    size_t workers = std::min(std::min(parallel_threads(), (size_t)8), by_size);
+    return workers < 1 ? 1 : workers;
+}
+
+// Sorts order[] (indices) with less(); chunks are sorted as parallel_for
+// tasks and merged pairwise, also in parallel. Inside a parallel for each
+// the pool is busy, so the calling thread ends up doing the tasks itself
+// instead of starting more threads. std::merge and std::stable_sort keep
+// equal elements in their original order, so stable sorts stay stable.
+template <typename Less>
+void parallel_sort_indices(std::vector<size_t> &order, Less less, bool stable) {
+    size_t n = order.size();
+    size_t workers = worker_count(n);
+    if (workers <= 1) {
+        if (stable) std::stable_sort(order.begin(), order.end(), less);
+        else std::sort(order.begin(), order.end(), less);
+        return;
+    }
+
+    std::vector<size_t> bounds;
+    for (size_t w = 0; w <= workers; ++w) bounds.push_back(n * w / workers);
+
+    parallel_for(workers, [&](size_t w) {
+        auto first = order.begin() + bounds[w], last = order.begin() + bounds[w+1];
+        if (stable) std::stable_sort(first, last, less);
+        else std::sort(first, last, less);
+    });
+
+    std::vector<size_t> buf(n);
+    std::vector<size_t> *src = &order, *dst = &buf;
+    while (bounds.size() > 2) {
+        std::vector<size_t> next;
+        for (size_t b = 0; b + 1 < bounds.size(); b += 2) next.push_back(bounds[b]);
+        next.push_back(n);
+        // Pair p merges runs 2p and 2p+1; an odd run out is carried over
+        parallel_for(next.size() - 1, [&](size_t p) {
+            size_t b = 2 * p;
+            if (b + 2 >= bounds.size()) {
+                std::copy(src->begin() + bounds[b], src->begin() + bounds[b+1], dst->begin() + bounds[b]);
+                return;
+            }
+            size_t lo = bounds[b], mid = bounds[b+1], hi = bounds[b+2];
+            std::merge(src->begin() + lo, src->begin() + mid, src->begin() + mid, src->begin() + hi,
+                       dst->begin() + lo, less);
+        });
+        bounds.swap(next);
+        std::swap(src, dst);
+    }
+    if (src != &order) order.swap(buf);
+}
+
+// Rearranges items into the given order, moving each Value exactly once
+void apply_order(std::vector<Value> &items, const std::vector<size_t> &order) {
+    std::vector<Value> out;
+    out.reserve(items.size());
+    for (size_t idx : order) out.push_back(std::move(items[idx]));
+    items.swap(out);
+}
+
+} // namespace
+
+int compare_values(const Value &a, const Value &b) {
+    int ra = type_rank(a.type), rb = type_rank(b.type);
+    if (ra != rb) return ra < rb ? -1 : 1;
+    switch (a.type) {
+        case Value::Type::YesNo: return (int)a.as_yesno() - (int)b.as_yesno();
+        case Value::Type::Number: return compare_numbers(a.as_number(), b.as_number());
+        case Value::Type::Word: {
+            int c = a.word_value.compare(b.word_value);
+            return c < 0 ? -1 : (c > 0 ? 1 : 0);
+        }
+        case Value::Type::List: {
+            const List &x = a.as_list(), &y = b.as_list();
+            for (size_t i = 0; i < x.size() && i < y.size(); ++i) {
+                int c = compare_values(x[i], y[i]);
+                if (c != 0) return c;
+            }
+            return x.size() < y.size() ? -1 : (x.size() > y.size() ? 1 : 0);
+        }
+        case Value::Type::Numbers: {
+            const std::vector<double> &x = a.numbers_value->data, &y = b.numbers_value->data;
+            for (size_t i = 0; i < x.size() && i < y.size(); ++i) {
+                int c = compare_numbers(x[i], y[i]);
+                if (c != 0) return c;
+            }
+            return x.size() < y.size() ? -1 : (x.size() > y.size() ? 1 : 0);
+        }
+        default:
+            return 0; // other containers of one type are all equivalent
+    }
+}
+
+void sort_doubles(std::vector<double> &data, bool descending) {
+    if (data.size() < kRadixMin) {
+        std::sort(data.begin(), data.end(), [](double x, double y) { return compare_numbers(x, y) < 0; });
+    } else {
+        // NaNs go last, set aside so they keep their exact bits
+        std::vector<uint64_t> keys;
+        std::vector<double> nans;
+        keys.reserve(data.size());
+        for (double d : data) {
+            if (std::isnan(d)) nans.push_back(d);
+            else keys.push_back(radix_key(d));
+        }
+        if (!keys.empty()) radix_sort_keys(keys);
+        for (size_t i = 0; i < keys.size(); ++i) data[i] = from_radix_key(keys[i]);
+        std::copy(nans.begin(), nans.end(), data.begin() + keys.size());
+    }
+    if (descending) std::reverse(data.begin(), data.end());
+}
+
+void sort_list(std::vector<Value> &items, bool descending, bool stable) {
+    // Fast path: every element is a number, so order is all that matters
+    bool all_numbers = true;
+    for (auto &v : items) {
+        if (v.type != Value::Type::Number) { all_numbers = false; break; }
+    }
+    if (all_numbers) {
+        std::vector<double> nums(items.size());
+        for (size_t i = 0; i < items.size(); ++i) nums[i] = items[i].as_number();
+        sort_doubles(nums, descending);
+        for (size_t i = 0; i < items.size(); ++i) items[i].number_value = nums[i];
+        return;
+    }
+
+    std::vector<size_t> order(items.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    const std::vector<Value> &ref = items;
+    if (descending) {
+        parallel_sort_indices(order, [&ref](size_t x, size_t y) { return compare_values(ref[y], ref[x]) < 0; }, stable);
+    } else {
+        parallel_sort_indices(order, [&ref](size_t x, size_t y) { return compare_values(ref[x], ref[y]) < 0; }, stable);
+    }
+    apply_order(items, order);
+}
+
+// Stable sort of items by precomputed keys (keys[i] belongs to items[i])
+void sort_list_by_keys(std::vector<Value> &items, const std::vector<Value> &keys, bool descending) {
+    std::vector<size_t> order(items.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    if (descending) {
+        parallel_sort_indices(order, [&keys](size_t x, size_t y) { return compare_values(keys[y], keys[x]) < 0; }, true);
+    } else {
+        parallel_sort_indices(order, [&keys](size_t x, size_t y) { return compare_values(keys[x], keys[y]) < 0; }, true);
+    }
+    apply_order(items, order);
+}
@@ -0,0 +1,12 @@
+# --batch prints each script's output under its name, then a status table
+# and a summary line. Times and the thread count depend on the machine, so
+# they are masked.
+mkdir scripts
+printf 'show "fine"\n' > scripts/a_ok.simplic
+printf 'show "before"\nload list x from "missing.txt"\nshow "after"\n' > scripts/b_error.simplic
+printf 'repeat 1000 times\n    make number n = 1\ndone\n' > scripts/c_budget.simplic
+printf 'show "fine"\n' > scripts/d_same_as_a.simplic
+"$SIMPLIC" --batch scripts --max-steps 100 > out.txt
+echo "exit status $?"
+sed -e 's/[0-9][0-9]*\.[0-9][0-9][0-9]  /T.TTT  /' \
+    -e 's/[0-9][0-9]* threads; [0-9.]*s$/N threads; T.TTTs/' out.txt
@@ -0,0 +1,27 @@
+# A program read back from the compiled-program cache prints exactly what a
+# fresh compile does, and changing the script is never answered from the cache
+cat > prog.simplic <<'SCRIPT'
+define square with x
+    giveback x times x
+done
+make number total = 0
+for each i in range(0, 10)
+    when i mod 2 equals 0
+        make number total = total plus square(i)
+    done
+done
+make list words = ["b", "a", "c"]
+words.sort()
+show total, words, 2 plus 3 times 4
+SCRIPT
+"$SIMPLIC" --no-cache prog.simplic > fresh.txt
+ls "$SIMPLIC_CACHE_DIR" 2> /dev/null | wc -l
+"$SIMPLIC" prog.simplic > first.txt
+ls "$SIMPLIC_CACHE_DIR" | wc -l
+"$SIMPLIC" prog.simplic > cached.txt
+ls "$SIMPLIC_CACHE_DIR" | wc -l
+cat fresh.txt
+cmp fresh.txt first.txt && cmp fresh.txt cached.txt && echo "same output"
+sed 's/times 4/times 5/' prog.simplic > prog2.simplic
+mv prog2.simplic prog.simplic
+"$SIMPLIC" prog.simplic
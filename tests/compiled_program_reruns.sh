@@ -0,0 +1,21 @@
+# A compiled program run again starts from a clean slate: the same script
+# listed three times is prepared once, and no run sees what the one before
+# it made
+cat > counter.simplic <<'SCRIPT'
+show "seen before:", runs, seen
+make number runs = 0
+make map seen
+define mark with k
+    seen[k] = yes
+done
+repeat 3 times
+    make number runs = runs plus 1
+    mark(runs)
+done
+show runs, seen.keys()
+SCRIPT
+printf 'counter.simplic\ncounter.simplic\ncounter.simplic\n' > list.txt
+"$SIMPLIC" --batch list.txt > out.txt
+echo "exit status $?"
+sed -e '/^status/,$d' out.txt
+grep -o '[0-9]* scripts, [0-9]* ok, [0-9]* failed; [0-9]* distinct programs' out.txt
@@ -0,0 +1,24 @@
+# The interactive mode waits for done before running a block, keeps what
+# earlier lines defined, and :time reports a run time and whether the line
+# had been compiled before. Times are masked.
+"$SIMPLIC" > out.txt 2>&1 <<'INPUT'
+make number total = 0
+define double with k
+    giveback k times 2
+done
+repeat 3 times
+    make number total = total plus double(1)
+done
+:time show total
+:time show total
+:time
+when total morethan 5
+    show "big"
+done
+:time
+:time repeat 2 times
+:nope
+show "still here"
+INPUT
+echo "exit status $?"
+sed -e 's/time: [0-9.]* *[a-zµ]*s/time: T/' -e 's/(compile [0-9.]* *[a-zµ]*s)/(compile T)/' out.txt
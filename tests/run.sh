@@ -0,0 +1,41 @@
+#!/bin/sh
+# Runs every tests/*.simplic script and compares what it prints (output and
+# errors together) with the .expected file next to it. Each script runs in
+# an empty scratch directory, so files it saves and loads by relative path
+# go there and are removed afterwards.
+# Tests that need options, typed input or a second run are tests/*.sh shell
+# scripts instead: they run in the scratch directory with $SIMPLIC set to the
+# interpreter and a cache folder of their own, and what they print is
+# compared the same way.
+# Usage: tests/run.sh [path to simplic]   (default: ./simplic)
+abs() {
+    case "$1" in
+        /*) echo "$1" ;;
+        *) echo "$(pwd)/$1" ;;
+    esac
+}
+simplic=$(abs "${1:-./simplic}")
+dir=$(cd "$(dirname "$0")" && pwd)
+failed=0
+run() {
+    scratch=$(mktemp -d)
+    case "$1" in
+        *.sh) (cd "$scratch" && SIMPLIC="$simplic" SIMPLIC_CACHE_DIR="$scratch/cache" sh "$1" 2>&1) ;;
+        *) (cd "$scratch" && "$simplic" --no-cache "$1" 2>&1) ;;
+    esac
+    rm -rf "$scratch"
+}
+for script in "$dir"/*.simplic "$dir"/*.sh; do
+    [ "$script" = "$dir/run.sh" ] && continue
+    [ -f "$script" ] || continue
+    expected="${script%.*}.expected"
+    name="tests/${script##*/}"
+    if run "$script" | diff -u "$expected" - > /dev/null; then
+        echo "ok      $name"
+    else
+        echo "FAILED  $name"
+        run "$script" | diff -u "$expected" -
+        failed=$((failed + 1))
+    fi
+done
+[ "$failed" -eq 0 ]
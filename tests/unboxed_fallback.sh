@@ -0,0 +1,29 @@
+# Arithmetic on names that only ever hold numbers runs on plain doubles; a
+# name that changes type, or one a restored snapshot fills with a word, is
+# worked out the ordinary way and gives the same answers as unoptimized code
+cat > changes.simplic <<'SCRIPT'
+define twice with v
+    giveback v plus v
+done
+make number x = 2
+make number total = 0
+repeat 3 times
+    make number total = total plus x times 2
+done
+show total, twice(4), twice("ab")
+make word x = "x"
+show x plus 1, x equals "x"
+SCRIPT
+"$SIMPLIC" changes.simplic
+cat > make_word.simplic <<'SCRIPT'
+make word n = "n"
+snapshot "word.snap"
+SCRIPT
+"$SIMPLIC" make_word.simplic
+cat > numbers_only.simplic <<'SCRIPT'
+show n plus 1, n times 2, n lessthan 3
+make number n = 5
+show n plus 1, n times 2, n lessthan 3
+SCRIPT
+"$SIMPLIC" numbers_only.simplic
+"$SIMPLIC" --restore word.snap numbers_only.simplic
@@ -0,0 +1,104 @@
+// text.cpp
+// Word text: shared write-once buffers, in-place appends and the intern
+// table for word literals (see text.hpp)
+
+#include "text.hpp"
+#include "memstats.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+Text::Buffer::Buffer(size_t cap)
+    : chars(new char[cap ? cap : 1]), capacity(cap), used(0), counted(mem_stats_on.load(std::memory_order_relaxed)) {
+    if (counted) mem_object_added(MemKind::Word, sizeof(Buffer) + capacity);
+}
+
+Text::Buffer::~Buffer() {
+    if (counted) mem_object_removed(MemKind::Word, sizeof(Buffer) + capacity);
+}
+
+std::shared_ptr<Text::Buffer> Text::make_buffer(size_t cap) {
+    return std::make_shared<Buffer>(cap);
+}
+
+// FNV-1a, continued from h over n more bytes
+size_t Text::hash_more(size_t h, const char *s, size_t n) {
+    uint64_t x = (uint64_t)h;
+    for (size_t k = 0; k < n; ++k) {
+        x ^= (unsigned char)s[k];
+        x *= 1099511628211ULL;
+    }
+    return (size_t)x;
+}
+
+Text::Text(const char *s, size_t n) : len(n), h(hash_more(kEmptyHash, s, n)) {
+    if (!n) return;
+    buf = make_buffer(n);
+    std::memcpy(buf->chars.get(), s, n);
+    buf->used.store(n, std::memory_order_relaxed);
+}
+
+Text Text::intern(const std::string &s) {
+    static std::mutex m;
+    static std::unordered_map<std::string, std::weak_ptr<Buffer>> table;
+    static size_t purge_at = 1024;
+
+    if (s.empty()) return Text();
+    std::lock_guard<std::mutex> lock(m);
+    auto &slot = table[s];
+    if (auto b = slot.lock()) return Text(b, 0, s.size(), hash_more(kEmptyHash, s.data(), s.size()));
+    Text t(s);
+    t.buf->interned_len = s.size();
+    slot = t.buf;
+    // Literals of programs that are gone leave dead entries behind
+    if (table.size() >= purge_at) {
+        for (auto it = table.begin(); it != table.end();) {
+            if (it->second.expired()) it = table.erase(it);
+            else ++it;
+        }
+        purge_at = std::max<size_t>(1024, table.size() * 2);
+    }
+    return t;
+}
+
+Text Text::substr(size_t pos, size_t n) const {
+    pos = std::min(pos, len);
+    n = std::min(n, len - pos);
+    if (n == len) return *this;
+    if (!n) return Text();
+    return Text(buf, off + pos, n, hash_more(kEmptyHash, data() + pos, n));
+}
+
+Text Text::append(const char *s, size_t n) const {
+    if (!n) return *this;
+    size_t end = off + len;
+    size_t hash = hash_more(h, s, n);
+    if (buf && end + n <= buf->capacity) {
+        size_t expected = end;
+        if (buf->used.compare_exchange_strong(expected, end + n, std::memory_order_relaxed)) {
+            std::memcpy(buf->chars.get() + end, s, n);
+            return Text(buf, off, len + n, hash);
+        }
+    }
+    // No room, or someone else already wrote past this text: a new buffer
+    // with space to grow into
+    auto b = make_buffer(std::max<size_t>(16, 2 * (len + n)));
+    std::memcpy(b->chars.get(), data(), len);
+    std::memcpy(b->chars.get() + len, s, n);
+    b->used.store(len + n, std::memory_order_relaxed);
+    return Text(b, 0, len + n, hash);
+}
+
+int Text::compare(const Text &o) const {
+    int c = std::memcmp(data(), o.data(), std::min(len, o.len));
+    if (c) return c;
+    return len < o.len ? -1 : len > o.len ? 1 : 0;
+}
+
+bool Text::operator==(const Text &o) const {
+    if (len != o.len || h != o.hash()) return false;
+    if (buf == o.buf && off == o.off) return true;
+    if (interned() && o.interned()) return false;
+    return std::memcmp(data(), o.data(), len) == 0;
+}
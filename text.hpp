@@ -0,0 +1,79 @@
+// SimpliC Language - Words
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <string>
+
+// The text of a word: a view (offset, length) into a shared, write-once
+// buffer. Copies and substrings share the buffer instead of copying it; the
+// hash is computed when the text is made and carried along with it.
+//
+// Buffers only ever grow at their end, so appending to a text that ends
+// where its buffer's written part ends claims the room after it and writes
+// in place; every other text on that buffer still sees only its own bytes.
+// Building a word up one piece at a time is then amortised O(1) per piece.
+class Text {
+public:
+    Text() = default;
+    Text(const std::string &s) : Text(s.data(), s.size()) {}
+    Text(const char *s) : Text(s, std::strlen(s)) {}
+    Text(const char *s, size_t n);
+
+    // One shared text per distinct string; equal interned texts compare
+    // equal by pointer. Used for word literals.
+    static Text intern(const std::string &s);
+
+    size_t size() const { return len; }
+    bool empty() const { return len == 0; }
+    const char *data() const { return buf ? buf->chars.get() + off : ""; }
+    std::string str() const { return std::string(data(), len); }
+    size_t hash() const { return h; }
+
+    // n bytes from pos (both clamped), sharing this text's buffer
+    Text substr(size_t pos, size_t n = std::string::npos) const;
+    // This text followed by s
+    Text append(const char *s, size_t n) const;
+    Text append(const Text &t) const { return append(t.data(), t.len); }
+
+    int compare(const Text &o) const;
+    bool operator==(const Text &o) const;
+    bool operator!=(const Text &o) const { return !(*this == o); }
+    bool operator<(const Text &o) const { return compare(o) < 0; }
+
+private:
+    struct Buffer {
+        std::unique_ptr<char[]> chars;
+        size_t capacity;
+        std::atomic<size_t> used;
+        size_t interned_len = 0;  // set once for interned buffers
+        bool counted;             // against MemKind::Word
+
+        explicit Buffer(size_t cap);
+        ~Buffer();
+    };
+
+    std::shared_ptr<Buffer> buf;
+    size_t off = 0, len = 0;
+    size_t h = kEmptyHash;
+
+    static const size_t kEmptyHash = (size_t)14695981039346656037ULL;
+
+    Text(std::shared_ptr<Buffer> b, size_t o, size_t n, size_t hash) : buf(std::move(b)), off(o), len(n), h(hash) {}
+    bool interned() const { return buf && buf->interned_len && off == 0 && len == buf->interned_len; }
+    static size_t hash_more(size_t h, const char *s, size_t n);
+    static std::shared_ptr<Buffer> make_buffer(size_t cap);
+};
+
+inline std::ostream &operator<<(std::ostream &os, const Text &t) {
+    return os.write(t.data(), (std::streamsize)t.size());
+}
+
+namespace std {
+template <> struct hash<Text> {
+    size_t operator()(const Text &t) const { return t.hash(); }
+};
+}
@@ -3,6 +3,8 @@
 
 #include "simplic.hpp"
 #include "dsa.hpp"
+#include <cmath>
+#include <stdexcept>
 
 std::string Value::to_string() const {
     switch (type) {
@@ -12,7 +14,7 @@ std::string Value::to_string() const {
             ss << number_value;
             return ss.str();
         }
-        case Type::Word: return word_value;
+        case Type::Word: return word_value.str();
         case Type::YesNo: return yesno_value ? "yes" : "no";
         case Type::List: {
             std::string s = "[";
@@ -25,7 +27,17 @@ std::string Value::to_string() const {
             s += "]";
             return s;
         }
-        case Type::Map: return "{map}";
+        case Type::Map: {
+            std::string s = "{";
+            bool first = true;
+            map_value->each([&](const std::string &k, const Value &v) {
+                if (!first) s += ", ";
+                s += k + ": " + v.to_string();
+                first = false;
+            });
+            s += "}";
+            return s;
+        }
         case Type::Function: return "<function>";
         case Type::Stack: return "<stack>";
         case Type::Queue: return "<queue>";
@@ -33,6 +45,72 @@ std::string Value::to_string() const {
         case Type::Set: return set_value ? set_value->to_string() : "<set>";
         case Type::BST: return bst_value ? bst_value->to_string() : "<bst>";
         case Type::Graph: return graph_value ? graph_value->to_string() : "<graph>";
+        case Type::Numbers: return numbers_value ? numbers_value->to_string() : "<numbers>";
+        case Type::Sequence: {
+            std::string s = "[";
+            bool first = true;
+            seq_value->each([&](const Value &v) {
+                if (!first) s += ", ";
+                s += v.to_string();
+                first = false;
+                return true;
+            });
+            s += "]";
+            return s;
+        }
+        case Type::Heap: return "<heap>";
     }
     return "?";
 }
+
+// Sequence
+// Numbers from start towards stop; stop itself is only included when
+// inclusive is set and the steps land on it. Counts that don't fit a
+// size_t exactly (infinite, NaN or past 2^53) are an error, not a cast.
+std::shared_ptr<Sequence> Sequence::range(Number start, Number stop, Number step, bool inclusive) {
+    auto s = make_tracked<Sequence>();
+    s->start = start;
+    s->step = step;
+    if (step != 0) {
+        double span = (stop - start) / step;
+        double n = inclusive ? std::floor(span + 1e-9) + 1 : std::ceil(span - 1e-9);
+        if (std::isnan(n)) throw std::runtime_error("range: start, stop and step must be finite numbers");
+        if (n > 9007199254740992.0) throw std::runtime_error("range: too many items (more than 2^53)");
+        s->count = n > 0 ? (size_t)n : 0;
+    }
+    return s;
+}
+
+void Sequence::each(const std::function<bool(const Value &)> &f) const {
+    // Runs one element through the steps; false once f asks to stop
+    auto feed = [&](Value v) {
+        for (auto &stage : stages) {
+            Value r = stage.second.func_value({v});
+            if (stage.first) {
+                if (!(r.type == Value::Type::YesNo && r.as_yesno())) return true;
+            } else {
+                v = r;
+            }
+        }
+        return f(v);
+    };
+    if (is_range) {
+        for (size_t k = 0; k < count; ++k) {
+            if (!feed(Value::from_number(start + (double)k * step))) return;
+        }
+    } else if (source.type == Value::Type::List) {
+        for (auto &v : source.as_list()) {
+            if (!feed(v)) return;
+        }
+    } else if (source.type == Value::Type::Numbers) {
+        for (double x : source.numbers_value->data) {
+            if (!feed(Value::from_number(x))) return;
+        }
+    }
+}
+
+std::shared_ptr<Sequence> Sequence::with_stage(bool is_filter, const Value &fn) const {
+    auto s = make_tracked<Sequence>(*this);
+    s->stages.push_back(std::make_pair(is_filter, fn));
+    return s;
+}